@@ -0,0 +1,161 @@
+#include "../ccc/ccc.h"
+
+// Compares the STABS lexer against the helpers it replaced, which built up a
+// std::string for every token. Both are run over the same input and have to
+// produce the same tokens.
+
+static s64 old_eat_s64_literal(const char*& input);
+static std::string old_eat_identifier(const char*& input);
+static std::string make_identifier_input(u32 count);
+static std::string make_integer_input(u32 count);
+template <typename Callback>
+static void report(const char* name, u32 token_count, u32 repeats, Callback callback);
+
+int main(int argc, char** argv) {
+	u32 token_count = 1000000;
+	if(argc > 1) {
+		token_count = (u32) strtoul(argv[1], nullptr, 10);
+		verify(token_count > 0, "error: Invalid token count.\n");
+	}
+	u32 repeats = 5;
+
+	std::string identifiers = make_identifier_input(token_count);
+	std::string integers = make_integer_input(token_count);
+
+	// Make sure the two lexers agree before timing them.
+	const char* old_input = identifiers.c_str();
+	const char* new_input = identifiers.c_str();
+	for(u32 i = 0; i < token_count; i++) {
+		verify(old_eat_identifier(old_input) == eat_identifier(new_input), "error: Identifier %u differs.\n", i);
+		old_input++;
+		new_input++;
+	}
+	old_input = integers.c_str();
+	new_input = integers.c_str();
+	for(u32 i = 0; i < token_count; i++) {
+		verify(old_eat_s64_literal(old_input) == eat_s64_literal(new_input), "error: Integer %u differs.\n", i);
+		old_input++;
+		new_input++;
+	}
+
+	printf("%u tokens, best of %u runs\n", token_count, repeats);
+	report("identifiers (old)", token_count, repeats, [&]() {
+		const char* input = identifiers.c_str();
+		u64 total = 0;
+		for(u32 i = 0; i < token_count; i++) {
+			total += old_eat_identifier(input).size();
+			input++;
+		}
+		return total;
+	});
+	report("identifiers (new)", token_count, repeats, [&]() {
+		const char* input = identifiers.c_str();
+		u64 total = 0;
+		for(u32 i = 0; i < token_count; i++) {
+			total += eat_identifier(input).size();
+			input++;
+		}
+		return total;
+	});
+	report("integers (old)", token_count, repeats, [&]() {
+		const char* input = integers.c_str();
+		u64 total = 0;
+		for(u32 i = 0; i < token_count; i++) {
+			total += old_eat_s64_literal(input);
+			input++;
+		}
+		return total;
+	});
+	report("integers (new)", token_count, repeats, [&]() {
+		const char* input = integers.c_str();
+		u64 total = 0;
+		for(u32 i = 0; i < token_count; i++) {
+			total += eat_s64_literal(input);
+			input++;
+		}
+		return total;
+	});
+}
+
+static s64 old_eat_s64_literal(const char*& input) {
+	std::string number;
+	if(*input == '-') {
+		number = "-";
+		input++;
+	}
+	for(; *input != '\0'; input++) {
+		if(*input < '0' || *input > '9') {
+			break;
+		}
+		number += *input;
+	}
+	verify(number.size() > 0, "error: Unexpected '%c' (%02hhx).\n", *input, *input);
+	try {
+		return std::stol(number);
+	} catch(std::out_of_range&) {
+		return 0;
+	}
+}
+
+static std::string old_eat_identifier(const char*& input) {
+	std::string identifier;
+	bool first = true;
+	for(; *input != '\0'; input++) {
+		bool valid_char = false;
+		valid_char |= isprint(*input) && *input != ':' && *input != ';';
+		valid_char |= !first && isalnum(*input);
+		if(valid_char) {
+			identifier += *input;
+		} else {
+			return identifier;
+		}
+		first = false;
+	}
+	verify_not_reached("error: Unexpected end of input.\n");
+}
+
+// Names like the ones that show up in type and field definitions, each
+// followed by a ':'.
+static std::string make_identifier_input(u32 count) {
+	static const char* words[] = {
+		"int", "char", "unsigned int", "long long int", "float", "m_position",
+		"next", "CollisionPrimitive", "m_pVertexBuffer", "_reserved", "x", "flags"
+	};
+	std::string input;
+	for(u32 i = 0; i < count; i++) {
+		input += words[i % (sizeof(words) / sizeof(words[0]))];
+		if(i % 3 == 0) {
+			input += std::to_string(i % 100);
+		}
+		input += ':';
+	}
+	return input;
+}
+
+// Type numbers, offsets, sizes and range bounds, each followed by a ','.
+static std::string make_integer_input(u32 count) {
+	static const char* numbers[] = {
+		"1", "32", "-2147483648", "2147483647", "0", "128", "4294967295", "17", "-1", "1024"
+	};
+	std::string input;
+	for(u32 i = 0; i < count; i++) {
+		input += numbers[i % (sizeof(numbers) / sizeof(numbers[0]))];
+		input += ',';
+	}
+	return input;
+}
+
+template <typename Callback>
+static void report(const char* name, u32 token_count, u32 repeats, Callback callback) {
+	double best = 0;
+	u64 checksum = 0;
+	for(u32 i = 0; i < repeats; i++) {
+		auto begin = std::chrono::steady_clock::now();
+		checksum += callback();
+		std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - begin;
+		if(i == 0 || seconds.count() < best) {
+			best = seconds.count();
+		}
+	}
+	printf("%-20s %8.1f million tokens/s (checksum %lx)\n", name, token_count / best / 1e6, checksum);
+}
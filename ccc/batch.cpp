@@ -0,0 +1,97 @@
+#include "ccc.h"
+
+#include <atomic>
+#include <condition_variable>
+
+// Limits how many bytes of input are being processed at once.
+struct MemoryBudget {
+	std::mutex mutex;
+	std::condition_variable released;
+	u64 limit;
+	u64 in_use = 0;
+};
+
+static void load_batch_image(BatchImage& image, const BatchOptions& options);
+static void acquire_memory(MemoryBudget& budget, u64 size);
+static void release_memory(MemoryBudget& budget, u64 size);
+
+std::vector<fs::path> collect_batch_inputs(const std::vector<fs::path>& paths) {
+	std::vector<fs::path> inputs;
+	for(const fs::path& path : paths) {
+		if(!fs::is_directory(path)) {
+			inputs.emplace_back(path);
+			continue;
+		}
+		std::vector<fs::path> directory_inputs;
+		for(const fs::directory_entry& entry : fs::recursive_directory_iterator(path)) {
+			if(entry.is_regular_file() && is_supported_elf_file(entry.path())) {
+				directory_inputs.emplace_back(entry.path());
+			}
+		}
+		std::sort(directory_inputs.begin(), directory_inputs.end());
+		inputs.insert(inputs.end(), directory_inputs.begin(), directory_inputs.end());
+	}
+	return inputs;
+}
+
+void process_batch(const std::vector<fs::path>& paths, const BatchOptions& options, const std::function<void(u64 index, BatchImage& image)>& func) {
+	StatsScope scope("process batch");
+	MemoryBudget budget;
+	budget.limit = options.memory_limit;
+	std::atomic<u64> failed_count = 0;
+	parallel_for(paths.size(), options.thread_count, [&](u64 i) {
+		u64 size = 0;
+		{
+			BatchImage image;
+			image.path = paths[i];
+			try {
+				VerifyRecoveryScope recovery;
+				std::error_code error;
+				u64 file_size = fs::file_size(paths[i], error);
+				verify(!error, "error: Failed to stat '%s'.\n", paths[i].string().c_str());
+				acquire_memory(budget, file_size);
+				size = file_size;
+				load_batch_image(image, options);
+			} catch(VerifyFailure& failure) {
+				image.program = Program();
+				image.mdebug_section = nullptr;
+				image.symbol_table = SymbolTable();
+				image.error = std::move(failure.message);
+				failed_count++;
+			}
+			func(i, image);
+		}
+		release_memory(budget, size);
+	});
+	add_stats_counter("batch inputs", paths.size());
+	add_stats_counter("failed batch inputs", failed_count);
+}
+
+static void load_batch_image(BatchImage& image, const BatchOptions& options) {
+	image.program.images.emplace_back(map_program_image(image.path));
+	parse_elf_file(image.program, 0);
+	for(const ProgramSection& section : image.program.sections) {
+		if(section.type == ProgramSectionType::MIPS_DEBUG) {
+			image.mdebug_section = &section;
+		}
+	}
+	if(image.mdebug_section && options.parse_symbol_table) {
+		image.symbol_table = parse_symbol_table(image.program.images[0], *image.mdebug_section, 1, options.filter);
+	}
+}
+
+static void acquire_memory(MemoryBudget& budget, u64 size) {
+	std::unique_lock<std::mutex> lock(budget.mutex);
+	budget.released.wait(lock, [&]() {
+		return budget.in_use == 0 || size <= budget.limit - std::min(budget.in_use, budget.limit);
+	});
+	budget.in_use += size;
+}
+
+static void release_memory(MemoryBudget& budget, u64 size) {
+	{
+		std::lock_guard<std::mutex> lock(budget.mutex);
+		budget.in_use -= size;
+	}
+	budget.released.notify_all();
+}
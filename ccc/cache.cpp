@@ -0,0 +1,579 @@
+#include "ccc.h"
+
+#include <cerrno>
+#include <random>
+
+static const char CACHE_MAGIC[8] = {'C', 'C', 'C', 'C', 'A', 'C', 'H', 'E'};
+static const u32 CACHE_VERSION = 6;
+
+struct CacheWriter {
+	std::vector<u8> bytes;
+	
+	template <typename T>
+	CacheArray append(const T* data, u64 count) {
+		while(bytes.size() % 8 != 0) {
+			bytes.push_back(0);
+		}
+		CacheArray array = {bytes.size(), count};
+		const u8* begin = (const u8*) data;
+		bytes.insert(bytes.end(), begin, begin + count * sizeof(T));
+		return array;
+	}
+	
+	// For structs with padding. The space is zero filled and then only the
+	// members are copied over, so the output doesn't depend on whatever
+	// happened to be in the padding.
+	template <typename T, typename Copy>
+	CacheArray append_members(const T* data, u64 count, Copy copy) {
+		while(bytes.size() % 8 != 0) {
+			bytes.push_back(0);
+		}
+		CacheArray array = {bytes.size(), count};
+		bytes.resize(bytes.size() + count * sizeof(T), 0);
+		T* dest = (T*) &bytes[array.offset];
+		for(u64 i = 0; i < count; i++) {
+			copy(dest[i], data[i]);
+		}
+		return array;
+	}
+};
+
+static CacheString add_cache_string(std::vector<char>& strings, std::string_view str);
+static FILE* open_temp_file(const fs::path& path, fs::path& temp_path);
+static void copy_stabs_type(StabsType& dest, const StabsType& src);
+static void copy_stabs_field(StabsField& dest, const StabsField& src);
+static void copy_stabs_symbol(StabsSymbol& dest, const StabsSymbol& src);
+static bool validate_array(const SymbolTableCache& cache, const CacheArray& array, u64 element_size);
+static bool validate_strings(const SymbolTableCache& cache);
+static bool validate_stabs(const SymbolTableCache& cache);
+static bool validate_externals(const SymbolTableCache& cache);
+
+u64 hash_symbol_table_section(const ProgramImage& image, const ProgramSection& section) {
+	StatsScope scope("hash symbol table");
+	verify(image.bytes.contains(section.file_offset, section.size), "error: Failed to read MIPS debug section.\n");
+	return hash_bytes(&image.bytes[section.file_offset], section.size, section.file_offset);
+}
+
+bool write_symbol_table_cache(fs::path path, u64 key, const SymbolTable& symbol_table, const StabsTypeArena& stabs_arena, const std::vector<StabsInternedFile>& stabs_files) {
+	StatsScope scope("write cache");
+	verify(stabs_files.size() == symbol_table.files.size(), "error: STABS files don't match the symbol table.\n");
+	std::vector<CacheFile> files;
+	std::vector<CacheSymbol> symbols;
+	std::vector<char> strings;
+	std::vector<StabsSymbol> stabs_symbols;
+	std::vector<CacheString> stabs_texts;
+	std::vector<CacheTypeNumber> type_numbers;
+	std::vector<CacheProcedure> procedures;
+	for(const SymProcedureDescriptor& pd : symbol_table.procedures) {
+		CacheProcedure& dest = procedures.emplace_back();
+		dest.name = add_cache_string(strings, pd.name);
+		dest.address = pd.address;
+		dest.file = pd.file;
+		dest.symbol_index = pd.symbol_index;
+		dest.line_index = pd.line_index;
+		dest.register_mask = pd.register_mask;
+		dest.register_offset = pd.register_offset;
+		dest.float_register_mask = pd.float_register_mask;
+		dest.float_register_offset = pd.float_register_offset;
+		dest.frame_offset = pd.frame_offset;
+		dest.frame_register = pd.frame_register;
+		dest.return_register = pd.return_register;
+		dest.lines_low = pd.lines.low;
+		dest.lines_high = pd.lines.high;
+		dest.line_table_offset = pd.line_table_offset;
+	}
+	const ExternalSymbolTable& externals = symbol_table.externals;
+	std::vector<CacheString> external_names;
+	for(std::string_view name : externals.names) {
+		external_names.emplace_back(add_cache_string(strings, name));
+	}
+	for(size_t i = 0; i < symbol_table.files.size(); i++) {
+		const SymFileDescriptor& fd = symbol_table.files[i];
+		const StabsInternedFile& stabs_file = stabs_files[i];
+		CacheFile& file = files.emplace_back();
+		file.name = add_cache_string(strings, fd.name);
+		file.procedures_low = fd.procedures.low;
+		file.procedures_high = fd.procedures.high;
+		file.line_table_offset = fd.line_table_offset;
+		file.line_table_size = fd.line_table_size;
+		file.first_symbol = symbols.size();
+		file.symbol_count = fd.symbols.size();
+		for(Symbol sym : fd.symbols) {
+			CacheSymbol& dest = symbols.emplace_back();
+			dest.string = add_cache_string(strings, sym.string);
+			dest.value = sym.value;
+			dest.storage_type = (u32) sym.storage_type;
+			dest.storage_class = (u32) sym.storage_class;
+			dest.index = sym.index;
+		}
+		file.first_stabs_symbol = stabs_symbols.size();
+		file.stabs_symbol_count = stabs_file.symbols.size();
+		stabs_symbols.insert(stabs_symbols.end(), stabs_file.symbols.begin(), stabs_file.symbols.end());
+		for(const std::string& text : stabs_file.strings) {
+			stabs_texts.emplace_back(add_cache_string(strings, text));
+		}
+		file.first_type_number = type_numbers.size();
+		for(size_t j = 0; j < stabs_file.type_numbers.dense.size(); j++) {
+			if(stabs_file.type_numbers.dense[j] != NO_STABS_TYPE) {
+				type_numbers.push_back({(s64) j, stabs_file.type_numbers.dense[j]});
+			}
+		}
+		for(auto [type_number, type] : stabs_file.type_numbers.sparse) {
+			type_numbers.push_back({type_number, type});
+		}
+		for(auto [type_number, type] : stabs_file.type_numbers.shared) {
+			type_numbers.push_back({type_number, type});
+		}
+		std::sort(type_numbers.begin() + file.first_type_number, type_numbers.end(),
+			[](const CacheTypeNumber& lhs, const CacheTypeNumber& rhs) {
+				return lhs.type_number < rhs.type_number;
+			});
+		file.type_number_count = type_numbers.size() - file.first_type_number;
+	}
+	// The offsets wrap around if there's too much string data, so the whole
+	// thing has to be thrown away.
+	if(strings.size() > UINT32_MAX) {
+		return false;
+	}
+	
+	CacheWriter writer;
+	writer.bytes.resize(sizeof(CacheHeader));
+	CacheHeader header = {};
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.stabs_type_size = sizeof(StabsType);
+	header.key = key;
+	header.line_number_table_offset = symbol_table.line_number_table_offset;
+	header.procedure_descriptor_table_offset = symbol_table.procedure_descriptor_table_offset;
+	header.local_symbol_table_offset = symbol_table.local_symbol_table_offset;
+	header.file_descriptor_table_offset = symbol_table.file_descriptor_table_offset;
+	header.files = writer.append(files.data(), files.size());
+	header.symbols = writer.append(symbols.data(), symbols.size());
+	header.strings = writer.append(strings.data(), strings.size());
+	header.stabs_types = writer.append_members(stabs_arena.types.data(), stabs_arena.types.size(), copy_stabs_type);
+	header.stabs_fields = writer.append_members(stabs_arena.fields.data(), stabs_arena.fields.size(), copy_stabs_field);
+	header.stabs_enum_values = writer.append(stabs_arena.enum_values.data(), stabs_arena.enum_values.size());
+	header.stabs_strings = writer.append(stabs_arena.strings.data(), stabs_arena.strings.size());
+	header.stabs_symbols = writer.append_members(stabs_symbols.data(), stabs_symbols.size(), copy_stabs_symbol);
+	header.stabs_texts = writer.append(stabs_texts.data(), stabs_texts.size());
+	header.stabs_type_numbers = writer.append(type_numbers.data(), type_numbers.size());
+	header.procedures = writer.append(procedures.data(), procedures.size());
+	header.external_names = writer.append(external_names.data(), external_names.size());
+	header.external_values = writer.append(externals.values.data(), externals.values.size());
+	header.external_storage_types = writer.append(externals.storage_types.data(), externals.storage_types.size());
+	header.external_storage_classes = writer.append(externals.storage_classes.data(), externals.storage_classes.size());
+	header.external_files = writer.append(externals.files.data(), externals.files.size());
+	header.external_name_lookup = writer.append(externals.name_lookup.data(), externals.name_lookup.size());
+	header.external_sorted_by_name = writer.append(externals.sorted_by_name.data(), externals.sorted_by_name.size());
+	header.external_sorted_by_value = writer.append(externals.sorted_by_value.data(), externals.sorted_by_value.size());
+	memcpy(writer.bytes.data(), &header, sizeof(CacheHeader));
+	
+	// Write to a temporary file first so that a reader never sees a partially
+	// written cache.
+	fs::path temp_path;
+	FILE* file = open_temp_file(path, temp_path);
+	if(!file) {
+		return false;
+	}
+	bool written = fwrite(writer.bytes.data(), writer.bytes.size(), 1, file) == 1;
+	written &= fclose(file) == 0;
+	std::error_code error;
+	if(written) {
+		fs::rename(temp_path, path, error);
+	}
+	if(!written || error) {
+		fs::remove(temp_path, error);
+		return false;
+	}
+	return true;
+}
+
+static CacheString add_cache_string(std::vector<char>& strings, std::string_view str) {
+	CacheString result = {(u32) strings.size(), (u32) str.size()};
+	strings.insert(strings.end(), str.begin(), str.end());
+	strings.push_back('\0');
+	return result;
+}
+
+// Several processes may be writing the same cache at once, so each one gets
+// its own temporary file.
+static FILE* open_temp_file(const fs::path& path, fs::path& temp_path) {
+	std::random_device random;
+	for(s32 attempt = 0; attempt < 16; attempt++) {
+		char suffix[32];
+		snprintf(suffix, sizeof(suffix), ".%08x.tmp", random());
+		temp_path = path;
+		temp_path += suffix;
+		// The x flag fails if the file already exists.
+		FILE* file = fopen(temp_path.c_str(), "wbx");
+		if(file || errno != EEXIST) {
+			return file;
+		}
+	}
+	return nullptr;
+}
+
+static void copy_stabs_type(StabsType& dest, const StabsType& src) {
+	dest.descriptor = src.descriptor;
+	dest.aux_type = src.aux_type;
+	switch(src.descriptor) {
+		case StabsTypeDescriptor::ARRAY:
+			dest.array_type.index_type = src.array_type.index_type;
+			dest.array_type.element_type = src.array_type.element_type;
+			break;
+		case StabsTypeDescriptor::ENUM:
+			dest.enum_type.first_value = src.enum_type.first_value;
+			dest.enum_type.value_count = src.enum_type.value_count;
+			break;
+		case StabsTypeDescriptor::RANGE:
+			dest.range_type.type = src.range_type.type;
+			dest.range_type.low = src.range_type.low;
+			dest.range_type.high = src.range_type.high;
+			break;
+		case StabsTypeDescriptor::STRUCT:
+		case StabsTypeDescriptor::UNION:
+			dest.struct_type.type_number = src.struct_type.type_number;
+			dest.struct_type.first_field = src.struct_type.first_field;
+			dest.struct_type.field_count = src.struct_type.field_count;
+			dest.struct_type.base_class = src.struct_type.base_class;
+			break;
+		case StabsTypeDescriptor::POINTER:
+			dest.pointer_type.value_type = src.pointer_type.value_type;
+			break;
+		default:
+			dest.type_reference.type_number = src.type_reference.type_number;
+	}
+}
+
+static void copy_stabs_field(StabsField& dest, const StabsField& src) {
+	dest.name = src.name;
+	dest.type = src.type;
+	dest.offset = src.offset;
+	dest.size = src.size;
+	dest.type_name = src.type_name;
+}
+
+static void copy_stabs_symbol(StabsSymbol& dest, const StabsSymbol& src) {
+	dest.name = src.name;
+	dest.descriptor = src.descriptor;
+	dest.type_number = src.type_number;
+	dest.type = src.type;
+}
+
+bool map_symbol_table_cache(SymbolTableCache& cache, fs::path path, u64 key) {
+	std::error_code error;
+	if(!fs::is_regular_file(path, error)) {
+		return false;
+	}
+	cache.image = map_program_image(path);
+	if(!cache.image.bytes.contains(0, sizeof(CacheHeader))) {
+		return false;
+	}
+	cache.header = (const CacheHeader*) cache.image.bytes.data();
+	const CacheHeader& header = *cache.header;
+	if(memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+		|| header.version != CACHE_VERSION
+		|| header.stabs_type_size != sizeof(StabsType)
+		|| header.key != key) {
+		return false;
+	}
+	// Check the bounds of all the arrays up front, so the accessors don't
+	// need to.
+	bool valid = validate_array(cache, header.files, sizeof(CacheFile))
+		&& validate_array(cache, header.symbols, sizeof(CacheSymbol))
+		&& validate_array(cache, header.strings, 1)
+		&& validate_array(cache, header.stabs_types, sizeof(StabsType))
+		&& validate_array(cache, header.stabs_fields, sizeof(StabsField))
+		&& validate_array(cache, header.stabs_enum_values, sizeof(StabsEnumValue))
+		&& validate_array(cache, header.stabs_strings, 1)
+		&& validate_array(cache, header.stabs_symbols, sizeof(StabsSymbol))
+		&& validate_array(cache, header.stabs_texts, sizeof(CacheString))
+		&& validate_array(cache, header.stabs_type_numbers, sizeof(CacheTypeNumber))
+		&& validate_array(cache, header.procedures, sizeof(CacheProcedure))
+		&& validate_array(cache, header.external_names, sizeof(CacheString))
+		&& validate_array(cache, header.external_values, sizeof(u32))
+		&& validate_array(cache, header.external_storage_types, sizeof(u8))
+		&& validate_array(cache, header.external_storage_classes, sizeof(u8))
+		&& validate_array(cache, header.external_files, sizeof(s16))
+		&& validate_array(cache, header.external_name_lookup, sizeof(u32))
+		&& validate_array(cache, header.external_sorted_by_name, sizeof(u32))
+		&& validate_array(cache, header.external_sorted_by_value, sizeof(u32));
+	if(!valid) {
+		return false;
+	}
+	u64 external_count = header.external_names.count;
+	if(header.external_values.count != external_count
+		|| header.external_storage_types.count != external_count
+		|| header.external_storage_classes.count != external_count
+		|| header.external_files.count != external_count
+		|| header.external_sorted_by_name.count != external_count
+		|| header.external_sorted_by_value.count != external_count) {
+		return false;
+	}
+	if(header.stabs_texts.count != header.stabs_symbols.count) {
+		return false;
+	}
+	// The line number code indexes the procedures of each file and the file
+	// of each procedure without checking.
+	for(u64 i = 0; i < header.files.count; i++) {
+		const CacheFile& file = cache.file(i);
+		if(file.procedures_low < 0
+			|| file.procedures_low > file.procedures_high
+			|| (u64) file.procedures_high > header.procedures.count
+			|| file.first_symbol > header.symbols.count
+			|| file.symbol_count > header.symbols.count - file.first_symbol
+			|| file.first_stabs_symbol > header.stabs_symbols.count
+			|| file.stabs_symbol_count > header.stabs_symbols.count - file.first_stabs_symbol
+			|| file.first_type_number > header.stabs_type_numbers.count
+			|| file.type_number_count > header.stabs_type_numbers.count - file.first_type_number) {
+			return false;
+		}
+	}
+	const CacheProcedure* procedures = cache.array<CacheProcedure>(header.procedures);
+	for(u64 i = 0; i < header.procedures.count; i++) {
+		if(procedures[i].file < 0 || (u64) procedures[i].file >= header.files.count) {
+			return false;
+		}
+	}
+	// Everything that the accessors return is checked here too, so that a
+	// corrupted file can't send them out of bounds.
+	return validate_strings(cache) && validate_stabs(cache) && validate_externals(cache);
+}
+
+static bool validate_array(const SymbolTableCache& cache, const CacheArray& array, u64 element_size) {
+	return array.count <= UINT64_MAX / element_size
+		&& cache.image.bytes.contains(array.offset, array.count * element_size);
+}
+
+static bool validate_strings(const SymbolTableCache& cache) {
+	const CacheHeader& header = *cache.header;
+	// Leave room for the null terminator.
+	auto valid = [&](CacheString str) {
+		return (u64) str.offset + str.size < header.strings.count;
+	};
+	for(u64 i = 0; i < header.files.count; i++) {
+		if(!valid(cache.file(i).name)) {
+			return false;
+		}
+	}
+	const CacheSymbol* symbols = cache.array<CacheSymbol>(header.symbols);
+	for(u64 i = 0; i < header.symbols.count; i++) {
+		if(!valid(symbols[i].string)) {
+			return false;
+		}
+	}
+	const CacheProcedure* procedures = cache.array<CacheProcedure>(header.procedures);
+	for(u64 i = 0; i < header.procedures.count; i++) {
+		if(!valid(procedures[i].name)) {
+			return false;
+		}
+	}
+	for(const CacheArray* array : {&header.external_names, &header.stabs_texts}) {
+		const CacheString* strings = cache.array<CacheString>(*array);
+		for(u64 i = 0; i < array->count; i++) {
+			if(!valid(strings[i])) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// The interner only ever refers back to types that it has already added, so
+// any index that doesn't point backwards means the file is corrupted. This
+// also rules out cycles, which would otherwise hang the field visitor.
+static bool validate_stabs(const SymbolTableCache& cache) {
+	const CacheHeader& header = *cache.header;
+	StabsTypeArenaView arena = cache.stabs_arena();
+	auto valid_string = [&](StabsString str) {
+		return (u64) str.offset + str.size <= arena.strings.count;
+	};
+	auto valid_field = [&](const StabsField& field, StabsTypeIndex parent) {
+		return field.type < parent && valid_string(field.name) && valid_string(field.type_name);
+	};
+	for(u64 i = 0; i < arena.types.count; i++) {
+		const StabsType& type = arena.types[i];
+		bool valid = type.aux_type == NO_STABS_TYPE || type.aux_type < i;
+		switch(type.descriptor) {
+			case StabsTypeDescriptor::ARRAY:
+				valid &= type.array_type.index_type < i && type.array_type.element_type < i;
+				break;
+			case StabsTypeDescriptor::ENUM:
+				valid &= type.enum_type.first_value <= arena.enum_values.count
+					&& type.enum_type.value_count <= arena.enum_values.count - type.enum_type.first_value;
+				break;
+			case StabsTypeDescriptor::RANGE:
+				valid &= type.range_type.type < i;
+				break;
+			case StabsTypeDescriptor::STRUCT:
+			case StabsTypeDescriptor::UNION: {
+				const StabsType::StructOrUnion& struct_type = type.struct_type;
+				valid &= struct_type.base_class == NO_STABS_TYPE || struct_type.base_class < i;
+				valid &= struct_type.first_field <= arena.fields.count
+					&& struct_type.field_count <= arena.fields.count - struct_type.first_field;
+				for(u32 j = 0; valid && j < struct_type.field_count; j++) {
+					valid &= valid_field(arena.fields[struct_type.first_field + j], i);
+				}
+				break;
+			}
+			case StabsTypeDescriptor::POINTER:
+				valid &= type.pointer_type.value_type < i;
+				break;
+			default: {}
+		}
+		if(!valid) {
+			return false;
+		}
+	}
+	for(u64 i = 0; i < arena.enum_values.count; i++) {
+		if(!valid_string(arena.enum_values[i].name)) {
+			return false;
+		}
+	}
+	const StabsSymbol* symbols = cache.array<StabsSymbol>(header.stabs_symbols);
+	for(u64 i = 0; i < header.stabs_symbols.count; i++) {
+		const StabsSymbol& symbol = symbols[i];
+		if(!valid_string(symbol.name) || (symbol.type != NO_STABS_TYPE && symbol.type >= arena.types.count)) {
+			return false;
+		}
+	}
+	// The type numbers of each file have to be sorted for the binary search.
+	const CacheTypeNumber* type_numbers = cache.array<CacheTypeNumber>(header.stabs_type_numbers);
+	for(u64 i = 0; i < header.files.count; i++) {
+		const CacheFile& file = cache.file(i);
+		for(u64 j = 0; j < file.type_number_count; j++) {
+			const CacheTypeNumber& type_number = type_numbers[file.first_type_number + j];
+			if(type_number.type >= arena.types.count
+				|| (j > 0 && type_number.type_number <= type_numbers[file.first_type_number + j - 1].type_number)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool validate_externals(const SymbolTableCache& cache) {
+	const CacheHeader& header = *cache.header;
+	u64 count = header.external_names.count;
+	// The hash table is probed with a mask, and the probing only stops at an
+	// empty slot, so there has to be at least one.
+	u64 capacity = header.external_name_lookup.count;
+	if(capacity != 0 && (capacity & (capacity - 1)) != 0) {
+		return false;
+	}
+	const u32* name_lookup = cache.array<u32>(header.external_name_lookup);
+	bool has_empty_slot = capacity == 0;
+	for(u64 i = 0; i < capacity; i++) {
+		if(name_lookup[i] == UINT32_MAX) {
+			has_empty_slot = true;
+		} else if(name_lookup[i] >= count) {
+			return false;
+		}
+	}
+	if(!has_empty_slot) {
+		return false;
+	}
+	for(const CacheArray* array : {&header.external_sorted_by_name, &header.external_sorted_by_value}) {
+		const u32* indices = cache.array<u32>(*array);
+		for(u64 i = 0; i < array->count; i++) {
+			if(indices[i] >= count) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+std::string_view SymbolTableCache::string(CacheString str) const {
+	return std::string_view(array<char>(header->strings) + str.offset, str.size);
+}
+
+StabsTypeArenaView SymbolTableCache::stabs_arena() const {
+	return {
+		{array<StabsType>(header->stabs_types), header->stabs_types.count},
+		{array<StabsField>(header->stabs_fields), header->stabs_fields.count},
+		{array<StabsEnumValue>(header->stabs_enum_values), header->stabs_enum_values.count},
+		{array<char>(header->stabs_strings), header->stabs_strings.count}
+	};
+}
+
+StabsTypeIndex SymbolTableCache::lookup_type_number(const CacheFile& file, s64 type_number) const {
+	const CacheTypeNumber* begin = array<CacheTypeNumber>(header->stabs_type_numbers) + file.first_type_number;
+	const CacheTypeNumber* end = begin + file.type_number_count;
+	const CacheTypeNumber* iter = std::lower_bound(begin, end, type_number,
+		[](const CacheTypeNumber& lhs, s64 rhs) { return lhs.type_number < rhs; });
+	return (iter != end && iter->type_number == type_number) ? iter->type : NO_STABS_TYPE;
+}
+
+SymbolTable load_symbol_table_from_cache(const SymbolTableCache& cache) {
+	StatsScope scope("load symbol table from cache");
+	// The strings are left pointing into the cache file.
+	SymbolTable symbol_table;
+	symbol_table.line_number_table_offset = cache.header->line_number_table_offset;
+	symbol_table.procedure_descriptor_table_offset = cache.header->procedure_descriptor_table_offset;
+	symbol_table.local_symbol_table_offset = cache.header->local_symbol_table_offset;
+	symbol_table.file_descriptor_table_offset = cache.header->file_descriptor_table_offset;
+	symbol_table.storage = cache.image.storage;
+	const CacheProcedure* procedures = cache.array<CacheProcedure>(cache.header->procedures);
+	symbol_table.procedures.resize(cache.header->procedures.count);
+	for(u64 i = 0; i < cache.header->procedures.count; i++) {
+		const CacheProcedure& src = procedures[i];
+		SymProcedureDescriptor& pd = symbol_table.procedures[i];
+		pd.name = cache.string(src.name);
+		pd.address = src.address;
+		pd.file = src.file;
+		pd.symbol_index = src.symbol_index;
+		pd.line_index = src.line_index;
+		pd.register_mask = src.register_mask;
+		pd.register_offset = src.register_offset;
+		pd.float_register_mask = src.float_register_mask;
+		pd.float_register_offset = src.float_register_offset;
+		pd.frame_offset = src.frame_offset;
+		pd.frame_register = src.frame_register;
+		pd.return_register = src.return_register;
+		pd.lines = {src.lines_low, src.lines_high};
+		pd.line_table_offset = src.line_table_offset;
+	}
+	const CacheHeader& header = *cache.header;
+	ExternalSymbolTable& externals = symbol_table.externals;
+	const CacheString* external_names = cache.array<CacheString>(header.external_names);
+	for(u64 i = 0; i < header.external_names.count; i++) {
+		externals.names.emplace_back(cache.string(external_names[i]));
+	}
+	auto copy_array = [&](auto& dest, const CacheArray& src) {
+		using Element = typename std::remove_reference_t<decltype(dest)>::value_type;
+		const Element* begin = cache.array<Element>(src);
+		dest.assign(begin, begin + src.count);
+	};
+	copy_array(externals.values, header.external_values);
+	copy_array(externals.storage_types, header.external_storage_types);
+	copy_array(externals.storage_classes, header.external_storage_classes);
+	copy_array(externals.files, header.external_files);
+	copy_array(externals.name_lookup, header.external_name_lookup);
+	copy_array(externals.sorted_by_name, header.external_sorted_by_name);
+	copy_array(externals.sorted_by_value, header.external_sorted_by_value);
+	
+	symbol_table.files.resize(cache.file_count());
+	for(u64 i = 0; i < cache.file_count(); i++) {
+		const CacheFile& file = cache.file(i);
+		SymFileDescriptor& fd = symbol_table.files[i];
+		fd.name = cache.string(file.name);
+		fd.procedures = {file.procedures_low, file.procedures_high};
+		fd.line_table_offset = file.line_table_offset;
+		fd.line_table_size = file.line_table_size;
+		SymbolList& dest = fd.symbols;
+		dest.strings = cache.array<char>(header.strings);
+		dest.resize(file.symbol_count);
+		const CacheSymbol* symbols = cache.symbols(file);
+		for(u64 j = 0; j < file.symbol_count; j++) {
+			const CacheSymbol& sym = symbols[j];
+			dest.values[j] = sym.value;
+			dest.storage_types[j] = (u8) sym.storage_type;
+			dest.storage_classes[j] = (u8) sym.storage_class;
+			dest.indices[j] = sym.index;
+			dest.name_offsets[j] = sym.string.offset;
+			dest.name_sizes[j] = sym.string.size;
+		}
+	}
+	return symbol_table;
+}
@@ -1,12 +1,24 @@
 #pragma once
 
+#include <memory>
+#include <algorithm>
 #include <vector>
 #include <cstdio>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <ctime>
+#include <unordered_map>
+#include <mutex>
+#include <string_view>
 #include <filesystem>
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
 
 // *****************************************************************************
 // util.cpp
@@ -24,27 +36,47 @@ using s16 = int16_t;
 using s32 = int32_t;
 using s64 = int64_t;
 
+// Thrown by verify instead of exiting while a VerifyRecoveryScope is active.
+struct VerifyFailure {
+	// Without the trailing newline.
+	std::string message;
+};
+
+// While one of these exists, verify failures on the current thread, and on
+// any threads started from it by parallel_for, throw a VerifyFailure instead
+// of exiting. Used where one bad input shouldn't take the whole process down.
+struct VerifyRecoveryScope {
+	bool previous;
+	
+	VerifyRecoveryScope();
+	VerifyRecoveryScope(const VerifyRecoveryScope&) = delete;
+	VerifyRecoveryScope& operator=(const VerifyRecoveryScope&) = delete;
+	~VerifyRecoveryScope();
+};
+
+bool is_verify_recoverable();
+// Prints the message and exits, or throws if a VerifyRecoveryScope is active.
+[[noreturn]] void report_verify_failure(const char* file, int line, const char* message);
+
 // Like assert, but for user errors.
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-security"
 template <typename... Args>
+[[noreturn]] void verify_failed(const char* file, int line, const char* error_message, Args... args) {
+	char message[1024];
+	snprintf(message, sizeof(message), error_message, args...);
+	report_verify_failure(file, line, message);
+}
+template <typename... Args>
 void verify_impl(const char* file, int line, bool condition, const char* error_message, Args... args) {
 	if(!condition) {
-		fprintf(stderr, "[%s:%d] ", file, line);
-		fprintf(stderr, error_message, args...);
-		exit(1);
+		verify_failed(file, line, error_message, args...);
 	}
 }
 #define verify(condition, ...) \
 	verify_impl(__FILE__, __LINE__, condition, __VA_ARGS__)
-template <typename... Args>
-[[noreturn]] void verify_not_reached_impl(const char* file, int line, const char* error_message, Args... args) {
-	fprintf(stderr, "[%s:%d] ", file, line);
-	fprintf(stderr, error_message, args...);
-	exit(1);
-}
 #define verify_not_reached(...) \
-	verify_not_reached_impl(__FILE__, __LINE__, __VA_ARGS__)
+	verify_failed(__FILE__, __LINE__, __VA_ARGS__)
 #pragma GCC diagnostic pop
 
 #ifdef _MSC_VER
@@ -55,25 +87,203 @@ template <typename... Args>
 		struct __attribute__((__packed__)) name { __VA_ARGS__ };
 #endif
 
+// A read-only view of some bytes from a file. This lets the parsers work the
+// same way regardless of whether the input file was read into memory, mapped,
+// or only partially loaded. Offsets are file offsets, so base is the file
+// offset of the first byte in the view.
+struct ByteSpan {
+	const u8* ptr = nullptr;
+	u64 count = 0;
+	u64 base = 0;
+	
+	ByteSpan() {}
+	ByteSpan(const u8* p, u64 c, u64 b = 0) : ptr(p), count(c), base(b) {}
+	ByteSpan(const std::vector<u8>& v) : ptr(v.data()), count(v.size()) {}
+	
+	const u8* data() const { return ptr; }
+	u64 size() const { return count; }
+	u64 end_offset() const { return base + count; }
+	bool contains(u64 offset, u64 size) const {
+		return offset >= base && offset - base <= count && size <= count - (offset - base);
+	}
+	const u8& operator[](u64 offset) const { return ptr[offset - base]; }
+};
+
 template <typename T>
-const T& get_packed(const std::vector<u8>& bytes, u64 offset, const char* subject) {
-	verify(bytes.size() >= offset + sizeof(T), "error: Failed to read %s.\n", subject);
+const T& get_packed(ByteSpan bytes, u64 offset, const char* subject) {
+	verify(bytes.contains(offset, sizeof(T)), "error: Failed to read %s.\n", subject);
 	return *(const T*) &bytes[offset];
 }
 
-std::string read_string(const std::vector<u8>& bytes, u64 offset);
+// A view of an array of packed structures. The whole range is bounds checked
+// when the span is created, so the elements can be accessed without checking
+// each of them again.
+template <typename T>
+struct PackedSpan {
+	const T* ptr = nullptr;
+	u64 count = 0;
+	
+	u64 size() const { return count; }
+	const T& operator[](u64 index) const { return ptr[index]; }
+	PackedSpan subspan(s64 first, s64 size, const char* subject) const {
+		verify(first >= 0 && size >= 0 && (u64) first <= count && (u64) size <= count - first,
+			"error: Failed to read %s.\n", subject);
+		return {ptr + first, (u64) size};
+	}
+};
+
+template <typename T>
+PackedSpan<T> get_packed_span(ByteSpan bytes, u64 offset, s64 count, const char* subject) {
+	verify(count >= 0, "error: Failed to read %s.\n", subject);
+	if(count == 0) {
+		return {};
+	}
+	verify((u64) count <= bytes.size() / sizeof(T) && bytes.contains(offset, count * sizeof(T)),
+		"error: Failed to read %s.\n", subject);
+	return {(const T*) &bytes[offset], (u64) count};
+}
+
+// Returns a view of a null terminated string without copying it. The view
+// points into the span, so it's only valid as long as the memory backing the
+// span is.
+std::string_view read_string_view(ByteSpan bytes, u64 offset);
+std::string read_string(ByteSpan bytes, u64 offset);
+// Matches a whole string against a pattern where * matches any run of
+// characters, including none, and ? matches any single character.
+bool match_glob(std::string_view pattern, std::string_view str);
+
+inline u32 count_trailing_zeros(u64 value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	return _BitScanForward64(&index, value) ? index : 64;
+#else
+	return value != 0 ? __builtin_ctzll(value) : 64;
+#endif
+}
+
+// A fast non-cryptographic hash, used for deduplication and cache keys.
+u64 hash_bytes(const void* data, u64 size, u64 seed = 0);
+inline u64 hash_combine(u64 seed, u64 value) {
+	return (seed ^ value) * 0x9e3779b97f4a7c15 + (seed >> 29);
+}
+
+// Calls func(i) for every i in [0, count) using up to thread_count threads.
+// Each thread takes the next unclaimed index when it finishes one, so a few
+// expensive items don't leave the other threads idle. If func throws, the
+// remaining items are skipped and the first exception is rethrown once all
+// the threads have stopped.
+void parallel_for(u64 count, u32 thread_count, const std::function<void(u64)>& func);
 
 struct Range {
 	s32 low;
 	s32 high;
 };
 
+// *****************************************************************************
+// output.cpp
+// *****************************************************************************
+
+// Collects output in a large buffer and writes it out with a single fwrite once
+// the buffer is full, instead of going through printf for every value. Any
+// remaining output is written when the buffer is destroyed.
+struct OutputBuffer {
+	FILE* file;
+	std::unique_ptr<char[]> data;
+	u64 size = 0;
+	u64 capacity;
+	
+	OutputBuffer(FILE* f, u64 c = 1 << 20) : file(f), data(std::make_unique<char[]>(c)), capacity(c) {}
+	OutputBuffer(const OutputBuffer&) = delete;
+	OutputBuffer& operator=(const OutputBuffer&) = delete;
+	~OutputBuffer();
+};
+
+void flush_output(OutputBuffer& out);
+inline void write_char(OutputBuffer& out, char c) {
+	if(out.size == out.capacity) {
+		flush_output(out);
+	}
+	out.data[out.size++] = c;
+}
+void write_string(OutputBuffer& out, std::string_view str);
+// Lowercase, padded with zeroes to at least min_digits digits like %0*lx.
+void write_hex(OutputBuffer& out, u64 value, u32 min_digits = 1);
+// Padded with spaces on the left to at least min_width characters like %*ld.
+void write_decimal(OutputBuffer& out, s64 value, u32 min_width = 0);
+// Writes a quoted JSON string, escaping it as necessary.
+void write_json_string(OutputBuffer& out, std::string_view str);
+
+// *****************************************************************************
+// stats.cpp
+// *****************************************************************************
+
+struct StatsPhase {
+	const char* name;
+	u32 thread;
+	u32 depth;
+	// Relative to when the collector was created.
+	u64 start_us;
+	u64 wall_us;
+	// CPU time of the thread that ran the phase, so this doesn't include any
+	// work handed off to other threads.
+	u64 cpu_us;
+};
+
+struct StatsCounter {
+	const char* name;
+	u64 value;
+};
+
+// Receives timings and counters from the library while it's installed with
+// set_stats_collector. When no collector is installed recording does nothing.
+struct StatsCollector {
+	std::mutex mutex;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<StatsPhase> phases;
+	std::vector<StatsCounter> counters;
+	// Maps StatsPhase::thread back to the thread it came from.
+	std::vector<std::thread::id> threads;
+};
+
+void set_stats_collector(StatsCollector* collector);
+StatsCollector* get_stats_collector();
+// Adds value to the named counter. The name must be a string literal.
+void add_stats_counter(const char* name, u64 value);
+
+// Records the time between its construction and destruction as a phase.
+struct StatsScope {
+	StatsCollector* collector;
+	const char* name;
+	u32 depth;
+	std::chrono::steady_clock::time_point wall_start;
+	u64 cpu_start_us;
+	
+	StatsScope(const char* n);
+	StatsScope(const StatsScope&) = delete;
+	StatsScope& operator=(const StatsScope&) = delete;
+	~StatsScope();
+};
+
+template <typename T>
+u64 vector_memory_usage(const std::vector<T>& vector) {
+	return vector.capacity() * sizeof(T);
+}
+
+// Prints a table of phases, indented by nesting level, followed by counters.
+void print_stats(const StatsCollector& collector, FILE* file);
+// Writes the phases out in the Chrome trace event format, which can be loaded
+// into chrome://tracing or Perfetto.
+void write_chrome_trace(const StatsCollector& collector, FILE* file);
+
 // *****************************************************************************
 // Core data structures
 // *****************************************************************************
 
 struct ProgramImage {
-	std::vector<u8> bytes;
+	ByteSpan bytes;
+	// Keeps the memory pointed to by bytes alive. This is either a heap
+	// allocation or a file mapping, depending on how the image was loaded.
+	std::shared_ptr<const void> storage;
 };
 
 // This is like a simplified ElfSectionType.
@@ -82,6 +292,9 @@ enum class ProgramSectionType {
 	OTHER
 };
 
+// Used for sections that haven't been read yet, see read_elf_headers.
+const u64 NO_IMAGE = UINT64_MAX;
+
 struct ProgramSection {
 	u64 image;
 	u64 file_offset;
@@ -110,35 +323,121 @@ enum class SymbolClass : u32 {
 	COMPILER_VERSION_INFO = 11
 };
 
+// The strings in these structures point into the string tables of the image
+// they were parsed from, see SymbolTable::storage.
 struct Symbol {
-	std::string string;
+	std::string_view string;
 	u32 value;
 	SymbolType storage_type;
 	SymbolClass storage_class;
 	u32 index;
 };
 
+// The local symbols of a file, stored as one array per column so that scans
+// that filter on the type or class don't have to touch the names. Indexing or
+// iterating over it produces Symbol values.
+struct SymbolList {
+	// The name offsets are relative to this.
+	const char* strings = nullptr;
+	std::vector<u32> values;
+	std::vector<u8> storage_types; // SymbolType
+	std::vector<u8> storage_classes; // SymbolClass
+	std::vector<u32> indices;
+	std::vector<u32> name_offsets;
+	std::vector<u32> name_sizes;
+	
+	struct Iterator {
+		const SymbolList* list;
+		u64 index;
+		Symbol operator*() const { return (*list)[index]; }
+		Iterator& operator++() { index++; return *this; }
+		bool operator!=(const Iterator& rhs) const { return index != rhs.index; }
+	};
+	
+	u64 size() const { return values.size(); }
+	void resize(u64 size);
+	std::string_view name(u64 i) const {
+		return std::string_view(strings + name_offsets[i], name_sizes[i]);
+	}
+	Symbol operator[](u64 i) const {
+		return {name(i), values[i], (SymbolType) storage_types[i], (SymbolClass) storage_classes[i], indices[i]};
+	}
+	u64 memory_usage() const {
+		return vector_memory_usage(values) + vector_memory_usage(storage_types)
+			+ vector_memory_usage(storage_classes) + vector_memory_usage(indices)
+			+ vector_memory_usage(name_offsets) + vector_memory_usage(name_sizes);
+	}
+	Iterator begin() const { return {this, 0}; }
+	Iterator end() const { return {this, size()}; }
+};
+
 struct SymFileDescriptor {
-	std::string name;
+	std::string_view name;
 	Range procedures;
-	std::vector<Symbol> symbols;
+	SymbolList symbols;
+	// Location of this file's packed line numbers, relative to the start of
+	// the line number table.
+	s32 line_table_offset;
+	s32 line_table_size;
 };
 
 struct SymProcedureDescriptor {
-	std::string name;
+	std::string_view name;
+	u32 address;
+	// Index of the file descriptor this procedure belongs to.
+	s32 file;
+	// Index of the PROC symbol, relative to the start of the file's symbols in
+	// the raw table. This is only an index into SymFileDescriptor::symbols if
+	// the symbol table was parsed without filtering the symbols.
+	s32 symbol_index;
+	s32 line_index;
+	s32 register_mask;
+	s32 register_offset;
+	s32 float_register_mask;
+	s32 float_register_offset;
+	s32 frame_offset;
+	s16 frame_register;
+	s16 return_register;
+	Range lines;
+	// Offset of this procedure's line numbers in the file's packed line table.
+	s32 line_table_offset;
+};
+
+// The external (global) symbols, stored as one array per column so that scans
+// over a single column don't have to touch the others.
+struct ExternalSymbolTable {
+	std::vector<std::string_view> names;
+	std::vector<u32> values;
+	std::vector<u8> storage_types; // SymbolType
+	std::vector<u8> storage_classes; // SymbolClass
+	std::vector<s16> files;
+	// Open addressing hash table mapping names to indices into the arrays
+	// above. The size is a power of two, and empty slots are UINT32_MAX.
+	std::vector<u32> name_lookup;
+	// Indices sorted by name and by value, for prefix and address lookups.
+	std::vector<u32> sorted_by_name;
+	std::vector<u32> sorted_by_value;
+	
+	u64 size() const { return names.size(); }
 };
 
 struct SymbolTable {
 	std::vector<SymProcedureDescriptor> procedures;
 	std::vector<SymFileDescriptor> files;
+	ExternalSymbolTable externals;
+	u64 line_number_table_offset;
 	u64 procedure_descriptor_table_offset;
 	u64 local_symbol_table_offset;
 	u64 file_descriptor_table_offset;
+	// Keeps the image that the strings point into alive.
+	std::shared_ptr<const void> storage;
 };
 
 struct Program {
 	std::vector<ProgramImage> images;
 	std::vector<ProgramSection> sections;
+	// Only used for loading sections on demand, see read_elf_headers.
+	std::shared_ptr<FILE> file;
 };
 
 // *****************************************************************************
@@ -146,13 +445,135 @@ struct Program {
 // *****************************************************************************
 
 ProgramImage read_program_image(fs::path path);
+// Maps the file into memory instead of reading it, so that only the pages that
+// are actually accessed get loaded. Falls back to read_program_image if mapping
+// isn't supported.
+ProgramImage map_program_image(fs::path path);
+// Hint that a section is about to be read, so the OS can start paging it in.
+void prefetch_program_section(const ProgramImage& image, const ProgramSection& section);
+// Accepts executables, relocatable object files and IOP modules.
 void parse_elf_file(Program& program, u64 image_index);
+// Checks the file header without reading the rest of the file, so that inputs
+// can be filtered before any of them are parsed.
+bool is_supported_elf_file(fs::path path);
+// Reads only the ELF file header and the section header table, leaving the
+// image of each section set to NO_IMAGE. The file is kept open so that the
+// sections that are actually needed can be read later.
+void read_elf_headers(Program& program, fs::path path);
+// Reads an arbitrary range of the file opened by read_elf_headers into a new
+// image, and returns its index.
+u64 read_program_range(Program& program, u64 file_offset, u64 size);
+// Reads a section into its own image if it hasn't been read already.
+void read_program_section(Program& program, ProgramSection& section);
 
 // *****************************************************************************
 // mdebug.cpp
 // *****************************************************************************
 
-SymbolTable parse_symbol_table(const ProgramImage& image, const ProgramSection& section);
+// Restricts which files and local symbols get parsed. Symbols are checked
+// against their raw table entries, so the ones that are skipped cost next to
+// nothing. A name prefix won't match the continuation strings of STABS symbols
+// that were split, so pass it to parse_stabs_files instead for those.
+// The symbols that are kept are packed together in each file's SymbolList, so
+// when filtering by type, class or name, positions in the list no longer match
+// the raw symbol indices, see SymProcedureDescriptor::symbol_index.
+struct SymbolFilter {
+	// Matched against the whole file name, see match_glob. Empty matches
+	// every file.
+	std::string file_pattern;
+	// Bit N is set if symbols with a type or class of N are kept.
+	u64 types = UINT64_MAX;
+	u32 classes = UINT32_MAX;
+	std::string name_prefix;
+};
+
+bool file_matches_filter(const SymbolFilter& filter, std::string_view file_name);
+bool symbol_matches_filter(const SymbolFilter& filter, const Symbol& symbol);
+
+// The file descriptors are independent of each other, so they can be parsed on
+// multiple threads. The result is the same regardless of thread_count. Files
+// that don't match the filter are left without any symbols, but procedure
+// descriptors are parsed for every file so that their indices don't change.
+// The local symbols of a file are compacted down to the ones that match the
+// filter, so indices into the raw table can't be used to look them up.
+SymbolTable parse_symbol_table(const ProgramImage& image, const ProgramSection& section, u32 thread_count = 1, const SymbolFilter& filter = SymbolFilter());
+// Only reads the file descriptor table. The symbols and procedures of each file
+// are left empty until parse_file_symbols is called for it, and the external
+// symbols aren't read at all.
+SymbolTable parse_file_descriptor_table(const ProgramImage& image, const ProgramSection& section);
+// Each file owns a separate slice of the procedures, so this can be called for
+// different files from multiple threads at once.
+void parse_file_symbols(SymbolTable& symbol_table, const ProgramImage& image, const ProgramSection& section, s64 index);
+
+// Hashes of the parts of a file descriptor's tables that it owns, but not of
+// their positions in the tables, so that the hashes of a file stay the same
+// when only the files before it change. Files that can't be hashed get zero.
+struct FileDescriptorHash {
+	// Covers everything that gets parsed, including the symbol values and the
+	// procedure descriptors.
+	u64 contents = 0;
+	// Only covers the names and kinds of the symbols, which is all that the
+	// STABS symbols depend on. This stays the same if the code just moved.
+	u64 names = 0;
+};
+
+std::vector<FileDescriptorHash> hash_file_descriptors(const ProgramImage& image, const ProgramSection& section);
+// Like parse_symbol_table, but the contents of each file with a source index
+// that isn't -1 are copied from that file in the previous symbol table instead
+// of being parsed. The sources have to have the same contents hash as the files.
+// If a file can't be copied, it's parsed anyway and its source is set to -1.
+SymbolTable reparse_symbol_table(const SymbolTable& previous, std::vector<s64>& sources, const ProgramImage& image, const ProgramSection& section, u32 thread_count = 1);
+
+struct StabsTypeArena;
+struct StabsSymbol;
+
+// Callbacks for visit_symbol_table. Any of them can be left empty.
+struct SymbolTableVisitor {
+	// Called before the contents of each file. The symbols of the file
+	// descriptor are filled in, but are only valid until the next call.
+	std::function<void(s64 index, const SymFileDescriptor& fd)> file;
+	std::function<void(const Symbol& symbol)> symbol;
+	std::function<void(const SymProcedureDescriptor& procedure)> procedure;
+	// The arena only contains the types from the current file.
+	std::function<void(const StabsTypeArena& arena, const StabsSymbol& symbol)> stabs_symbol;
+};
+
+// Walks over the symbol table in file order without building a SymbolTable, so
+// the memory used doesn't depend on the size of the table. Nothing from one
+// file is kept around after moving on to the next. The external symbols aren't
+// visited, and neither are files that don't match the filter.
+void visit_symbol_table(const ProgramImage& image, const ProgramSection& section, const SymbolTableVisitor& visitor, const SymbolFilter& filter = SymbolFilter());
+
+// Maps addresses to procedures. The start addresses are stored in Eytzinger
+// (breadth first) order so the search is branchless and cache friendly.
+struct ProcedureAddressIndex {
+	// One based, since that makes the child indices 2k and 2k+1.
+	std::vector<u32> addresses;
+	// For each entry in addresses, its position in sorted order.
+	std::vector<u32> ranks;
+	// Indices into SymbolTable::procedures, sorted by address.
+	std::vector<u32> sorted_procedures;
+};
+
+ProcedureAddressIndex build_procedure_address_index(const SymbolTable& symbol_table);
+// Returns the index of the procedure with the highest start address that is
+// less than or equal to the given address, or -1 if there isn't one. The
+// procedure descriptors don't store a size, so each procedure is assumed to
+// extend to the start of the next one.
+s64 lookup_procedure(const ProcedureAddressIndex& index, u32 address);
+// Appends the indices of all the symbols with the given type and class to
+// output. This only reads the type and class columns.
+void filter_symbols(std::vector<u32>& output, const SymbolList& symbols, SymbolType type, SymbolClass symbol_class);
+// Builds the name hash table and the sorted indices from the columns.
+void index_external_symbols(ExternalSymbolTable& externals);
+// These return -1 if no symbol was found.
+s64 lookup_external_symbol(const ExternalSymbolTable& externals, std::string_view name);
+// Finds the symbol with the highest value that is less than or equal to the
+// given address.
+s64 lookup_external_symbol_by_address(const ExternalSymbolTable& externals, u32 address);
+// Returns the indices of all the symbols whose names start with the prefix,
+// in sorted order.
+std::vector<u32> find_external_symbols_with_prefix(const ExternalSymbolTable& externals, std::string_view prefix);
 const char* symbol_type(SymbolType type);
 const char* symbol_class(SymbolClass symbol_class);
 
@@ -191,57 +612,598 @@ enum class StabsTypeDescriptor : s8 {
 	MEMBER = '@'
 };
 
-struct StabsField;
+// Index into StabsTypeArena::types.
+using StabsTypeIndex = u32;
+const StabsTypeIndex NO_STABS_TYPE = UINT32_MAX;
+
+// A string stored in StabsTypeArena::strings.
+struct StabsString {
+	u32 offset = 0;
+	u32 size = 0;
+};
 
 struct StabsType {
+	struct TypeReference { s64 type_number; };
+	struct Array { StabsTypeIndex index_type; StabsTypeIndex element_type; };
+	struct Enum { u32 first_value; u32 value_count; };
+	struct Range { StabsTypeIndex type; s64 low; s64 high; };
+	// The base class is the type following a '!', or NO_STABS_TYPE.
+	struct StructOrUnion { s64 type_number; u32 first_field; u32 field_count; StabsTypeIndex base_class; };
+	struct Pointer { StabsTypeIndex value_type; };
+	
 	StabsTypeDescriptor descriptor;
-	StabsType* aux_type = nullptr;
-	// Tagged "union" based on the value of the type descriptor.
-	struct {
-		s64 type_number;
-	} type_reference;
-	struct {
-		StabsType* index_type = nullptr;
-		StabsType* element_type = nullptr;
-	} array_type;
-	struct {
-		std::vector<std::pair<std::string, s64>> values;
-	} enum_type;
-	struct {
-		
-	} function_type;
-	struct {
-		StabsType* type;
-		s64 low;
-		s64 high;
-	} range_type;
-	struct {
-		s64 type_number;
-		std::vector<StabsField> fields;
-	} struct_type;
-	struct {
-		s64 type_number;
-		std::vector<StabsField> fields;
-	} union_type;
-	struct {
-		StabsType* value_type = nullptr;
-	} pointer_type;
+	StabsTypeIndex aux_type = NO_STABS_TYPE;
+	// Tagged union based on the value of the type descriptor.
+	union {
+		TypeReference type_reference = {};
+		Array array_type;
+		Enum enum_type;
+		Range range_type;
+		StructOrUnion struct_type;
+		StructOrUnion union_type;
+		Pointer pointer_type;
+	};
 };
 
 struct StabsField {
-	std::string name;
-	StabsType type;
-	s64 offset;
-	s64 size;
-	std::string type_name;
+	StabsString name;
+	StabsTypeIndex type = NO_STABS_TYPE;
+	s64 offset = 0;
+	s64 size = 0;
+	StabsString type_name;
+};
+
+struct StabsEnumValue {
+	StabsString name;
+	s64 value;
+};
+
+// The parts of an arena needed to read the types back, which can also point
+// into a mapped cache file instead, see SymbolTableCache.
+struct StabsTypeArenaView {
+	PackedSpan<StabsType> types;
+	PackedSpan<StabsField> fields;
+	PackedSpan<StabsEnumValue> enum_values;
+	PackedSpan<char> strings;
+	
+	const StabsType& type(StabsTypeIndex index) const { return types[index]; }
+	std::string_view string(StabsString str) const {
+		return std::string_view(strings.ptr + str.offset, str.size);
+	}
+};
+
+// Owns all the STABS types parsed from a symbol table. Types refer to each
+// other, their fields and their enum values by index, so the whole graph is
+// freed at once when the arena is destroyed.
+struct StabsTypeArena {
+	std::vector<StabsType> types;
+	std::vector<StabsField> fields;
+	std::vector<StabsEnumValue> enum_values;
+	std::vector<char> strings;
+	// Fields of structs that are still being parsed. They're only moved into
+	// the fields array once the whole struct has been parsed, so that the
+	// fields of each struct end up contiguous even if they're nested.
+	std::vector<StabsField> field_stack;
+	
+	const StabsType& type(StabsTypeIndex index) const { return types[index]; }
+	std::string_view string(StabsString str) const {
+		return std::string_view(strings.data() + str.offset, str.size);
+	}
+	StabsString add_string(std::string_view str);
+	StabsTypeArenaView view() const {
+		return {{types.data(), types.size()}, {fields.data(), fields.size()},
+			{enum_values.data(), enum_values.size()}, {strings.data(), strings.size()}};
+	}
+	u64 memory_usage() const {
+		return vector_memory_usage(types) + vector_memory_usage(fields)
+			+ vector_memory_usage(enum_values) + vector_memory_usage(strings)
+			+ vector_memory_usage(field_stack);
+	}
 };
 
 struct StabsSymbol {
-	std::string name;
+	StabsString name;
 	StabsSymbolDescriptor descriptor;
 	s64 type_number;
-	StabsType type;
+	StabsTypeIndex type = NO_STABS_TYPE;
+};
+
+// Maps the type numbers defined in a file to the types that define them.
+struct StabsTypeNumberIndex {
+	// Type numbers are normally allocated sequentially from 1, so they're
+	// stored in a flat array, with a map as a fallback for unusual values.
+	std::vector<StabsTypeIndex> dense;
+	std::unordered_map<s64, StabsTypeIndex> sparse;
+	// The numbers that StabsTypeInterner shares between files, which are
+	// negative. Sorted by number so they can be binary searched.
+	std::vector<std::pair<s64, StabsTypeIndex>> shared;
+	
+	void add(s64 type_number, StabsTypeIndex type);
+	StabsTypeIndex lookup(s64 type_number) const;
+};
+
+// The STABS symbols from a single file descriptor. Each file has its own
+// arena so that files can be parsed independently of each other.
+struct StabsFile {
+	StabsTypeArena arena;
+	// The full text of each symbol, after joining strings that were split.
+	std::vector<std::string> strings;
+	std::vector<StabsSymbol> symbols;
+	StabsTypeNumberIndex type_numbers;
+};
+
+StabsSymbol parse_stabs_symbol(const char* input, StabsTypeArena& arena);
+// The tokenizer used by the parser, exposed so the benchmark can call it. Values
+// that don't fit in 64 bits are returned as zero.
+s64 eat_s64_literal(const char*& input);
+std::string_view eat_identifier(const char*& input);
+// Collects the STABS strings from each file descriptor and then parses them on
+// up to thread_count threads. The output doesn't depend on the thread count.
+// Since nothing is returned until every file has been parsed, a malformed
+// symbol stops the program before anything from the files preceding it has
+// been printed, unlike when each symbol was printed as it was parsed.
+// Symbols whose names don't start with the prefix are skipped without being
+// parsed.
+std::vector<StabsFile> parse_stabs_files(const SymbolTable& symbol_table, u32 thread_count = 1, std::string_view name_prefix = std::string_view());
+// Parses the STABS symbols of a single file descriptor.
+StabsFile parse_stabs_file(const SymFileDescriptor& fd);
+// Indexes all the type definitions in a file, including ones nested inside
+// other types. Since this is done after the whole file has been parsed, types
+// that are referenced before they're defined are handled too.
+StabsTypeNumberIndex build_type_number_index(const StabsTypeArena& arena, const std::vector<StabsSymbol>& symbols);
+// Follows type references until a type that isn't a reference is reached.
+// Returns NO_STABS_TYPE if a type number isn't defined.
+StabsTypeIndex resolve_stabs_type(const StabsTypeArena& arena, const StabsTypeNumberIndex& index, StabsTypeIndex type);
+// For pointers, arrays and ranges, returns the resolved type that is pointed
+// to, the element type or the underlying type respectively. Returns
+// NO_STABS_TYPE for everything else.
+StabsTypeIndex stabs_inner_type(const StabsTypeArena& arena, const StabsTypeNumberIndex& index, StabsTypeIndex type);
+void print_stabs_type(const StabsTypeArena& arena, StabsTypeIndex type);
+// Print the fields of all the structs defined by a symbol, in the order that
+// they appear in the input.
+void print_stabs_symbol_fields(const StabsTypeArena& arena, const StabsSymbol& symbol);
+// Same as above, but calls func for each field instead of printing it.
+void for_each_stabs_symbol_field(const StabsTypeArenaView& arena, const StabsSymbol& symbol, const std::function<void(const StabsField& field)>& func);
+
+// *****************************************************************************
+// dedup.cpp
+// *****************************************************************************
+
+// The symbols from a single file after their types have been interned. The
+// types and strings they refer to live in the interner's arena.
+struct StabsInternedFile {
+	std::vector<std::string> strings;
+	std::vector<StabsSymbol> symbols;
+	// Maps the type numbers defined in this file to the shared types.
+	StabsTypeNumberIndex type_numbers;
+};
+
+// Stores each structurally unique STABS type from a set of files only once.
+// The same type usually has a different number in each file, so bare
+// references to named types are given a number that's shared between all the
+// files that define a type with that name, and each file's type number index
+// maps it to that file's definition. Bare references to unnamed types are only
+// considered equal if they come from the same file. The numbers of type
+// definitions are only used to build the index, so they aren't compared.
+struct StabsTypeInterner {
+	StabsTypeArena arena;
+	// The file that each bare reference to an unnamed type came from, indexed
+	// the same way as the types in the arena. UINT32_MAX for other types.
+	std::vector<u32> reference_files;
+	// Keyed by the symbol descriptor followed by the name. The shared numbers
+	// are negative so that they don't collide with the real ones.
+	std::unordered_map<std::string, s64> shared_type_numbers;
+	std::unordered_multimap<u64, StabsTypeIndex> lookup;
+	u32 file_count = 0;
+};
+
+StabsInternedFile intern_stabs_file(StabsTypeInterner& interner, const StabsFile& file);
+// Interns a whole symbol table's worth of files, freeing each file's arena and
+// moving its strings into the result as it goes.
+std::vector<StabsInternedFile> intern_stabs_files(StabsTypeInterner& interner, std::vector<StabsFile>& files);
+
+// *****************************************************************************
+// cache.cpp
+// *****************************************************************************
+
+// A cache file holds a parsed symbol table and its deduplicated STABS types,
+// stored as flat arrays so that it can be mapped and used directly. It's keyed
+// by a hash of the .mdebug section it was generated from.
+
+packed_struct(CacheArray,
+	u64 offset;
+	u64 count;
+)
+
+packed_struct(CacheString,
+	u32 offset; // Into the strings array.
+	u32 size;
+)
+
+packed_struct(CacheHeader,
+	char magic[8];
+	u32 version;
+	u32 stabs_type_size;
+	u64 key;
+	u64 line_number_table_offset;
+	u64 procedure_descriptor_table_offset;
+	u64 local_symbol_table_offset;
+	u64 file_descriptor_table_offset;
+	CacheArray files;           // CacheFile
+	CacheArray symbols;         // CacheSymbol
+	CacheArray strings;         // char, all null terminated
+	CacheArray stabs_types;     // StabsType
+	CacheArray stabs_fields;    // StabsField
+	CacheArray stabs_enum_values; // StabsEnumValue
+	CacheArray stabs_strings;   // char
+	CacheArray stabs_symbols;   // StabsSymbol
+	CacheArray stabs_texts;     // CacheString
+	CacheArray stabs_type_numbers; // CacheTypeNumber, sorted for each file
+	CacheArray procedures;      // CacheProcedure
+	CacheArray external_names;  // CacheString
+	CacheArray external_values; // u32
+	CacheArray external_storage_types; // u8
+	CacheArray external_storage_classes; // u8
+	CacheArray external_files;  // s16
+	CacheArray external_name_lookup; // u32
+	CacheArray external_sorted_by_name; // u32
+	CacheArray external_sorted_by_value; // u32
+)
+
+packed_struct(CacheFile,
+	CacheString name;
+	s32 procedures_low;
+	s32 procedures_high;
+	u64 first_symbol;
+	u64 symbol_count;
+	u64 first_stabs_symbol;
+	u64 stabs_symbol_count;
+	u64 first_type_number;
+	u64 type_number_count;
+	s32 line_table_offset;
+	s32 line_table_size;
+)
+
+packed_struct(CacheSymbol,
+	CacheString string;
+	u32 value;
+	u32 storage_type;
+	u32 storage_class;
+	u32 index;
+)
+
+packed_struct(CacheProcedure,
+	CacheString name;
+	u32 address;
+	s32 file;
+	s32 symbol_index;
+	s32 line_index;
+	s32 register_mask;
+	s32 register_offset;
+	s32 float_register_mask;
+	s32 float_register_offset;
+	s32 frame_offset;
+	s16 frame_register;
+	s16 return_register;
+	s32 lines_low;
+	s32 lines_high;
+	s32 line_table_offset;
+)
+
+packed_struct(CacheTypeNumber,
+	s64 type_number;
+	StabsTypeIndex type;
+)
+
+// A mapped cache file. The accessors read straight from the mapping, which has
+// already been checked by map_symbol_table_cache.
+struct SymbolTableCache {
+	ProgramImage image;
+	const CacheHeader* header = nullptr;
+	
+	template <typename T>
+	const T* array(const CacheArray& array) const {
+		return (const T*) &image.bytes[array.offset];
+	}
+	u64 file_count() const { return header->files.count; }
+	const CacheFile& file(u64 index) const { return array<CacheFile>(header->files)[index]; }
+	const CacheSymbol* symbols(const CacheFile& file) const {
+		return array<CacheSymbol>(header->symbols) + file.first_symbol;
+	}
+	std::string_view string(CacheString str) const;
+	Symbol symbol(const CacheFile& file, u64 index) const {
+		const CacheSymbol& sym = symbols(file)[index];
+		return {string(sym.string), sym.value, (SymbolType) sym.storage_type, (SymbolClass) sym.storage_class, sym.index};
+	}
+	// The deduplicated types, for use with for_each_stabs_symbol_field.
+	StabsTypeArenaView stabs_arena() const;
+	const StabsSymbol* stabs_symbols(const CacheFile& file) const {
+		return array<StabsSymbol>(header->stabs_symbols) + file.first_stabs_symbol;
+	}
+	// The full text of each STABS symbol, indexed the same way.
+	const CacheString* stabs_texts(const CacheFile& file) const {
+		return array<CacheString>(header->stabs_texts) + file.first_stabs_symbol;
+	}
+	// Binary searches the type numbers of a file.
+	StabsTypeIndex lookup_type_number(const CacheFile& file, s64 type_number) const;
+};
+
+// The cache key. This hashes the whole section rather than going by the size
+// or modification time of the input, so a rebuilt ELF can never pick up a
+// stale cache, but it means a hit still costs a full pass over the section.
+u64 hash_symbol_table_section(const ProgramImage& image, const ProgramSection& section);
+// Returns false if the cache couldn't be written, in which case the old file,
+// if any, is left alone.
+bool write_symbol_table_cache(fs::path path, u64 key, const SymbolTable& symbol_table, const StabsTypeArena& stabs_arena, const std::vector<StabsInternedFile>& stabs_files);
+// Returns false if the file doesn't exist, is from an older version, was
+// generated from a different symbol table, or is corrupted.
+bool map_symbol_table_cache(SymbolTableCache& cache, fs::path path, u64 key);
+// Copies the symbol table out of the cache, for code that needs a SymbolTable.
+// The strings still point into the mapping.
+SymbolTable load_symbol_table_from_cache(const SymbolTableCache& cache);
+
+// *****************************************************************************
+// symbolicate.cpp
+// *****************************************************************************
+
+struct ProcedureSampleCount {
+	// Index into SymbolTable::procedures, or -1 for addresses that come before
+	// the first procedure.
+	s64 procedure;
+	u64 count;
+};
+
+// Reads hexadecimal addresses separated by whitespace, with or without a 0x
+// prefix, until the end of the file. Each address must be at most 8 digits,
+// and anything else is an error.
+std::vector<u32> read_address_stream(FILE* file);
+// Sorts the addresses and then resolves them all in a single pass alongside
+// the sorted procedures. The result is sorted by count, highest first.
+std::vector<ProcedureSampleCount> symbolicate_addresses(const SymbolTable& symbol_table, const ProcedureAddressIndex& index, std::vector<u32>& addresses);
+
+// *****************************************************************************
+// lines.cpp
+// *****************************************************************************
+
+struct SymLineNumber {
+	u32 address;
+	s32 line;
+};
+
+// The line numbers for a single procedure. Consecutive instructions with the
+// same line number are merged into a single entry.
+struct ProcedureLineNumbers {
+	std::vector<SymLineNumber> lines;
+	u32 end_address = 0;
+};
+
+// The packed line number table is only decoded for a procedure the first time
+// that procedure is looked up. This is safe to do from multiple threads.
+struct LineNumberTable {
+	const SymbolTable* symbol_table = nullptr;
+	ByteSpan bytes;
+	std::unique_ptr<std::once_flag[]> decoded;
+	std::vector<ProcedureLineNumbers> procedures;
+};
+
+// The image must be the one the symbol table was parsed from, and both must
+// outlive the line number table.
+void init_line_number_table(LineNumberTable& table, const SymbolTable& symbol_table, const ProgramImage& image);
+const ProcedureLineNumbers& procedure_line_numbers(LineNumberTable& table, s64 procedure);
+// Returns -1 if the address isn't covered by the line number table.
+s32 lookup_line(LineNumberTable& table, const ProcedureAddressIndex& index, u32 address);
+// Returns the address of the first instruction of each block of code that was
+// generated for a given line in a given file.
+std::vector<u32> lookup_line_addresses(LineNumberTable& table, s32 file, s32 line);
+
+// *****************************************************************************
+// lazy.cpp
+// *****************************************************************************
+
+// A symbol table where only the file descriptor table is read up front. The
+// symbols, procedures and STABS types of each file are parsed the first time
+// they're asked for, so the cost of opening a single file doesn't depend on
+// the size of the whole program. This is safe to do from multiple threads.
+struct LazySymbolTable {
+	SymbolTable symbol_table;
+	ProgramImage image;
+	ProgramSection section;
+	std::unique_ptr<std::once_flag[]> symbols_parsed;
+	std::unique_ptr<std::once_flag[]> stabs_parsed;
+	std::vector<StabsFile> stabs_files;
+};
+
+void init_lazy_symbol_table(LazySymbolTable& table, const ProgramImage& image, const ProgramSection& section);
+// The procedures in the file's range of SymbolTable::procedures are filled in
+// at the same time as the symbols.
+const SymFileDescriptor& lazy_file(LazySymbolTable& table, s64 index);
+const StabsFile& lazy_stabs_file(LazySymbolTable& table, s64 index);
+// Returns -1 if there isn't a file with the given name. This doesn't parse
+// anything.
+s64 find_lazy_file(const LazySymbolTable& table, std::string_view name);
+
+// *****************************************************************************
+// batch.cpp
+// *****************************************************************************
+
+struct BatchOptions {
+	u32 thread_count = 1;
+	// Inputs aren't started while the total size of the ones that are still
+	// being processed would exceed this. The file size is used as the
+	// estimate, since the parsed symbol table is proportional to it. An input
+	// bigger than the limit on its own is still processed, just by itself.
+	u64 memory_limit = UINT64_MAX;
+	bool parse_symbol_table = true;
+	SymbolFilter filter;
+};
+
+struct BatchImage {
+	fs::path path;
+	// Set if the input couldn't be loaded or parsed, in which case the other
+	// fields are left empty. func is still called so it can report it.
+	std::string error;
+	Program program;
+	// Null if the input doesn't have a .mdebug section.
+	const ProgramSection* mdebug_section = nullptr;
+	// Only filled in if BatchOptions::parse_symbol_table is set.
+	SymbolTable symbol_table;
+};
+
+// Expands directories into all the supported ELF files they contain,
+// recursively, in a stable order. Other paths are passed through as is.
+std::vector<fs::path> collect_batch_inputs(const std::vector<fs::path>& paths);
+// Loads and parses each input on one of the threads, and then passes it to
+// func on the same thread. The image is freed once func returns, so func
+// should extract whatever it needs. A malformed input doesn't stop the batch,
+// see BatchImage::error. The order that inputs are passed to func
+// in isn't deterministic, but index is the position in paths.
+void process_batch(const std::vector<fs::path>& paths, const BatchOptions& options, const std::function<void(u64 index, BatchImage& image)>& func);
+
+// *****************************************************************************
+// incremental.cpp
+// *****************************************************************************
+
+// A parsed symbol table, along with what's needed to parse the next version of
+// the same program incrementally.
+struct IncrementalSymbolTable {
+	SymbolTable symbol_table;
+	std::vector<FileDescriptorHash> file_hashes;
+	// The STABS symbols of each file, before they're interned. Files that
+	// haven't changed are shared with the previous version.
+	std::vector<std::shared_ptr<const StabsFile>> stabs_files;
+	// How many files were copied from the previous version.
+	u64 reused_file_count = 0;
+	u64 reused_stabs_file_count = 0;
+};
+
+// Parses the symbol table and STABS symbols in a section. Files with the same
+// hashes as a file in the previous version are copied from it instead of being
+// parsed again, so when only a few files have changed since the last build,
+// only those files are reparsed. The STABS symbols of a file are still reused
+// if its code has only moved. The previous version can be null.
+IncrementalSymbolTable parse_symbol_table_incrementally(const ProgramImage& image, const ProgramSection& section, const IncrementalSymbolTable* previous, u32 thread_count = 1);
+
+// *****************************************************************************
+// query.cpp
+// *****************************************************************************
+
+struct NamedStabsType {
+	StabsTypeIndex type;
+	// The file the type was defined in, which is needed to resolve the type
+	// numbers it refers to.
+	u32 file;
+};
+
+// Everything needed to answer queries about a single program, built up front
+// so that each query is only a few lookups. Immutable once loaded.
+struct SymbolDatabase {
+	fs::path path;
+	fs::file_time_type modified;
+	Program program;
+	// The per-file STABS symbols in here are only kept so that the next
+	// version of the input can be loaded incrementally.
+	IncrementalSymbolTable symbols;
+	ProcedureAddressIndex procedure_index;
+	StabsTypeArena stabs_arena;
+	std::vector<StabsInternedFile> stabs_files;
+	// Type names and struct tags. If a name is defined more than once the
+	// first definition wins. The keys point into stabs_arena.
+	std::unordered_map<std::string_view, NamedStabsType> types_by_name;
+};
+
+// If a previous version of the database is given, only the files that have
+// changed since then are parsed.
+std::shared_ptr<const SymbolDatabase> load_symbol_database(const fs::path& path, u32 thread_count = 1, const SymbolDatabase* previous = nullptr);
+// Answers a single query. Supported queries are:
+//   symbol NAME          Look up an external symbol.
+//   address ADDRESS      Find the function containing an address.
+//   type NAME            Print a type and its fields.
+//   member TYPE OFFSET   Find the struct member at a byte offset.
+// Each line of the reply is terminated with a newline.
+void answer_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view query);
+
+// Holds the loaded databases and swaps them out for new ones when their input
+// files change, without blocking queries that are already running.
+struct SymbolServer {
+	std::vector<fs::path> paths;
+	u32 thread_count = 1;
+	std::mutex mutex;
+	std::vector<std::shared_ptr<const SymbolDatabase>> databases;
+	// When each input last failed to reload, so that it isn't retried until
+	// it's modified again. Only used by reload_modified_databases.
+	std::vector<fs::file_time_type> failed_modified;
+};
+
+void init_symbol_server(SymbolServer& server, const std::vector<fs::path>& paths, u32 thread_count);
+// Reloads every database whose input file has been modified since it was
+// loaded. Returns the number of databases that were reloaded. If an input
+// fails to load, a warning is printed and the old database is kept.
+u32 reload_modified_databases(SymbolServer& server);
+// Answers a query against all the databases, followed by a line containing
+// only "end" so that clients know where the reply stops.
+void answer_server_query(OutputBuffer& out, SymbolServer& server, std::string_view query);
+// Answers queries, one per line, until the end of the input. Returns false if
+// the output couldn't be written, e.g. because the client disconnected.
+bool serve_queries(SymbolServer& server, FILE* input, FILE* output);
+// Listens on a Unix domain socket and serves each connection on its own
+// thread, up to a fixed number of connections at once. SIGPIPE is ignored so
+// that a client disconnecting only ends its own connection. Only returns if
+// the socket can't be set up.
+void serve_queries_on_socket(SymbolServer& server, const fs::path& socket_path);
+
+// *****************************************************************************
+// diff.cpp
+// *****************************************************************************
+
+enum class DiffChange : u8 {
+	ADDED,
+	REMOVED,
+	CHANGED
+};
+
+// The strings point into the two symbol tables, which have to outlive the diff.
+struct SymbolDiff {
+	DiffChange change;
+	std::string_view name;
+	std::string_view file;
+	u32 old_value = 0;
+	u32 new_value = 0;
+};
+
+// Offsets and sizes are in bits, like in StabsField.
+struct FieldDiff {
+	DiffChange change;
+	std::string_view name;
+	s64 old_offset = 0;
+	s64 old_size = 0;
+	s64 new_offset = 0;
+	s64 new_size = 0;
+};
+
+struct StructDiff {
+	DiffChange change;
+	std::string_view name;
+	// Only filled in for structs that changed.
+	std::vector<FieldDiff> fields;
+};
+
+// Each list is sorted by name, except for the functions, which are sorted by
+// file and then by name.
+struct SymbolTableDiff {
+	// Functions are compared file by file, so one that moved to a different
+	// file shows up as being removed from one and added to the other.
+	std::vector<SymbolDiff> functions;
+	// The external symbols that aren't procedures.
+	std::vector<SymbolDiff> globals;
+	// Structs and unions, identified by name. If there are several different
+	// definitions with the same name, only the first of each is compared.
+	std::vector<StructDiff> structs;
+	// Files that hashed the same in both versions, so weren't looked at.
+	u64 unchanged_file_count = 0;
 };
 
-StabsSymbol parse_stabs_symbol(const char* input);
-void print_stabs_type(const StabsType& type);
+// Compares two versions of a program. Files are paired up by name, and the
+// contents of a pair of files are only compared if their hashes differ, so the
+// cost depends on how much has changed rather than on the size of the program.
+SymbolTableDiff diff_symbol_tables(const IncrementalSymbolTable& old_table, const IncrementalSymbolTable& new_table);
+const char* diff_change(DiffChange change);
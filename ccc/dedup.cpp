@@ -0,0 +1,313 @@
+#include "ccc.h"
+
+struct InternContext {
+	const StabsTypeArena& source;
+	// Maps indices in the source arena to indices in the interner's arena.
+	std::vector<StabsTypeIndex> remap;
+	// Maps the numbers of the named types defined in the source file to the
+	// numbers shared between files, see StabsTypeInterner. Zero for unnamed
+	// types, since the shared numbers are negative.
+	std::vector<s64> shared_type_numbers;
+	u32 file;
+};
+
+static void find_shared_type_numbers(StabsTypeInterner& interner, InternContext& context, const StabsFile& file);
+static StabsTypeIndex intern_type(StabsTypeInterner& interner, InternContext& context, const StabsType& type);
+static bool is_named_reference(const InternContext& context, const StabsType& type, s64& shared_number);
+static u64 hash_type(const InternContext& context, const StabsType& type);
+static bool types_equal(const StabsTypeInterner& interner, StabsTypeIndex candidate, const InternContext& context, const StabsType& type);
+static StabsTypeIndex remap_type(const InternContext& context, StabsTypeIndex index);
+
+StabsInternedFile intern_stabs_file(StabsTypeInterner& interner, const StabsFile& file) {
+	InternContext context{file.arena, {}, {}, interner.file_count++};
+	find_shared_type_numbers(interner, context, file);
+	
+	// Child types are always added to an arena before their parents, so by
+	// the time a type is interned all of its children have been too.
+	StabsInternedFile result;
+	context.remap.resize(file.arena.types.size());
+	for(size_t i = 0; i < file.arena.types.size(); i++) {
+		const StabsType& type = file.arena.types[i];
+		context.remap[i] = intern_type(interner, context, type);
+		if(type.descriptor == StabsTypeDescriptor::TYPE_REFERENCE && type.aux_type != NO_STABS_TYPE) {
+			result.type_numbers.add(type.type_reference.type_number, context.remap[type.aux_type]);
+		}
+	}
+	
+	result.symbols.reserve(file.symbols.size());
+	for(const StabsSymbol& symbol : file.symbols) {
+		StabsSymbol& interned = result.symbols.emplace_back(symbol);
+		interned.name = interner.arena.add_string(file.arena.string(symbol.name));
+		interned.type = remap_type(context, symbol.type);
+		if(interned.type != NO_STABS_TYPE) {
+			result.type_numbers.add(symbol.type_number, interned.type);
+		}
+	}
+	std::vector<std::pair<s64, StabsTypeIndex>>& shared = result.type_numbers.shared;
+	for(s64 type_number = 0; type_number < (s64) context.shared_type_numbers.size(); type_number++) {
+		s64 shared_number = context.shared_type_numbers[type_number];
+		StabsTypeIndex type = result.type_numbers.lookup(type_number);
+		if(shared_number != 0 && type != NO_STABS_TYPE) {
+			shared.emplace_back(shared_number, type);
+		}
+	}
+	std::sort(shared.begin(), shared.end());
+	return result;
+}
+
+std::vector<StabsInternedFile> intern_stabs_files(StabsTypeInterner& interner, std::vector<StabsFile>& files) {
+	StatsScope scope("deduplicate stabs types");
+	std::vector<StabsInternedFile> result;
+	result.reserve(files.size());
+	for(StabsFile& file : files) {
+		StabsInternedFile& interned = result.emplace_back(intern_stabs_file(interner, file));
+		interned.strings = std::move(file.strings);
+		file = StabsFile();
+	}
+	add_stats_counter("shared type names", interner.shared_type_numbers.size());
+	add_stats_counter("unique stabs types", interner.arena.types.size());
+	add_stats_counter("stabs arena bytes", interner.arena.memory_usage());
+	return result;
+}
+
+static void find_shared_type_numbers(StabsTypeInterner& interner, InternContext& context, const StabsFile& file) {
+	struct Definition {
+		StabsSymbolDescriptor descriptor;
+		std::string_view name;
+		s64 type_number;
+	};
+	std::vector<Definition> definitions;
+	for(const StabsSymbol& symbol : file.symbols) {
+		bool names_type = symbol.descriptor == StabsSymbolDescriptor::TYPE_NAME
+			|| symbol.descriptor == StabsSymbolDescriptor::ENUM_STRUCT_OR_TYPE_TAG;
+		// Very large type numbers are rare enough that they're just treated
+		// as unnamed.
+		if(names_type && symbol.type != NO_STABS_TYPE && symbol.type_number > 0 && symbol.type_number < 0x100000) {
+			definitions.push_back({symbol.descriptor, file.arena.string(symbol.name), symbol.type_number});
+		}
+	}
+	std::sort(definitions.begin(), definitions.end(), [](const Definition& lhs, const Definition& rhs) {
+		return lhs.descriptor != rhs.descriptor ? lhs.descriptor < rhs.descriptor : lhs.name < rhs.name;
+	});
+	
+	std::string key;
+	for(size_t i = 0; i < definitions.size();) {
+		size_t end = i + 1;
+		bool ambiguous = false;
+		for(; end < definitions.size() && definitions[end].descriptor == definitions[i].descriptor && definitions[end].name == definitions[i].name; end++) {
+			ambiguous |= definitions[end].type_number != definitions[i].type_number;
+		}
+		// A name that's defined more than once in a file can't be used to
+		// tell which definition a reference is talking about.
+		if(!ambiguous) {
+			const Definition& definition = definitions[i];
+			key.assign(1, (char) definition.descriptor);
+			key += definition.name;
+			s64 next_number = -(s64) interner.shared_type_numbers.size() - 1;
+			s64 shared_number = interner.shared_type_numbers.emplace(key, next_number).first->second;
+			if((u64) definition.type_number >= context.shared_type_numbers.size()) {
+				context.shared_type_numbers.resize(definition.type_number + 1, 0);
+			}
+			context.shared_type_numbers[definition.type_number] = shared_number;
+		}
+		i = end;
+	}
+}
+
+static StabsTypeIndex intern_type(StabsTypeInterner& interner, InternContext& context, const StabsType& type) {
+	u64 hash = hash_type(context, type);
+	auto [begin, end] = interner.lookup.equal_range(hash);
+	for(auto iter = begin; iter != end; iter++) {
+		if(types_equal(interner, iter->second, context, type)) {
+			return iter->second;
+		}
+	}
+	
+	StabsTypeArena& arena = interner.arena;
+	StabsType interned = type;
+	interned.aux_type = remap_type(context, type.aux_type);
+	u32 reference_file = UINT32_MAX;
+	switch(type.descriptor) {
+		case StabsTypeDescriptor::TYPE_REFERENCE: {
+			s64 shared_number;
+			if(is_named_reference(context, type, shared_number)) {
+				interned.type_reference.type_number = shared_number;
+			} else if(type.aux_type == NO_STABS_TYPE) {
+				reference_file = context.file;
+			}
+			break;
+		}
+		case StabsTypeDescriptor::ARRAY:
+			interned.array_type.index_type = remap_type(context, type.array_type.index_type);
+			interned.array_type.element_type = remap_type(context, type.array_type.element_type);
+			break;
+		case StabsTypeDescriptor::ENUM:
+			interned.enum_type.first_value = (u32) arena.enum_values.size();
+			for(u32 i = 0; i < type.enum_type.value_count; i++) {
+				StabsEnumValue value = context.source.enum_values[type.enum_type.first_value + i];
+				value.name = arena.add_string(context.source.string(value.name));
+				arena.enum_values.emplace_back(value);
+			}
+			break;
+		case StabsTypeDescriptor::RANGE:
+			interned.range_type.type = remap_type(context, type.range_type.type);
+			break;
+		case StabsTypeDescriptor::STRUCT:
+		case StabsTypeDescriptor::UNION:
+			interned.struct_type.base_class = remap_type(context, type.struct_type.base_class);
+			interned.struct_type.first_field = (u32) arena.fields.size();
+			for(u32 i = 0; i < type.struct_type.field_count; i++) {
+				StabsField field = context.source.fields[type.struct_type.first_field + i];
+				field.name = arena.add_string(context.source.string(field.name));
+				field.type = remap_type(context, field.type);
+				field.type_name = arena.add_string(context.source.string(field.type_name));
+				arena.fields.emplace_back(field);
+			}
+			break;
+		case StabsTypeDescriptor::POINTER:
+			interned.pointer_type.value_type = remap_type(context, type.pointer_type.value_type);
+			break;
+		default: {}
+	}
+	
+	StabsTypeIndex index = (StabsTypeIndex) arena.types.size();
+	arena.types.emplace_back(interned);
+	interner.reference_files.emplace_back(reference_file);
+	interner.lookup.emplace(hash, index);
+	return index;
+}
+
+static bool is_named_reference(const InternContext& context, const StabsType& type, s64& shared_number) {
+	if(type.aux_type != NO_STABS_TYPE) {
+		// This is a definition rather than a bare reference, so its meaning
+		// comes from the aux type instead.
+		return false;
+	}
+	s64 type_number = type.type_reference.type_number;
+	if(type_number < 0 || (u64) type_number >= context.shared_type_numbers.size()) {
+		return false;
+	}
+	shared_number = context.shared_type_numbers[type_number];
+	return shared_number != 0;
+}
+
+static u64 hash_string(std::string_view str) {
+	return hash_bytes(str.data(), str.size());
+}
+
+static u64 hash_type(const InternContext& context, const StabsType& type) {
+	const StabsTypeArena& source = context.source;
+	u64 hash = hash_combine((u64) type.descriptor, remap_type(context, type.aux_type));
+	switch(type.descriptor) {
+		case StabsTypeDescriptor::TYPE_REFERENCE: {
+			s64 shared_number;
+			if(is_named_reference(context, type, shared_number)) {
+				hash = hash_combine(hash, shared_number);
+			} else if(type.aux_type == NO_STABS_TYPE) {
+				hash = hash_combine(hash, type.type_reference.type_number);
+				hash = hash_combine(hash, context.file);
+			}
+			break;
+		}
+		case StabsTypeDescriptor::ARRAY:
+			hash = hash_combine(hash, remap_type(context, type.array_type.index_type));
+			hash = hash_combine(hash, remap_type(context, type.array_type.element_type));
+			break;
+		case StabsTypeDescriptor::ENUM:
+			for(u32 i = 0; i < type.enum_type.value_count; i++) {
+				const StabsEnumValue& value = source.enum_values[type.enum_type.first_value + i];
+				hash = hash_combine(hash, hash_string(source.string(value.name)));
+				hash = hash_combine(hash, value.value);
+			}
+			break;
+		case StabsTypeDescriptor::RANGE:
+			hash = hash_combine(hash, remap_type(context, type.range_type.type));
+			hash = hash_combine(hash, type.range_type.low);
+			hash = hash_combine(hash, type.range_type.high);
+			break;
+		case StabsTypeDescriptor::STRUCT:
+		case StabsTypeDescriptor::UNION:
+			hash = hash_combine(hash, type.struct_type.type_number);
+			hash = hash_combine(hash, remap_type(context, type.struct_type.base_class));
+			for(u32 i = 0; i < type.struct_type.field_count; i++) {
+				const StabsField& field = source.fields[type.struct_type.first_field + i];
+				hash = hash_combine(hash, hash_string(source.string(field.name)));
+				hash = hash_combine(hash, remap_type(context, field.type));
+				hash = hash_combine(hash, field.offset);
+				hash = hash_combine(hash, field.size);
+				hash = hash_combine(hash, hash_string(source.string(field.type_name)));
+			}
+			break;
+		case StabsTypeDescriptor::POINTER:
+			hash = hash_combine(hash, remap_type(context, type.pointer_type.value_type));
+			break;
+		default: {}
+	}
+	return hash;
+}
+
+static bool types_equal(const StabsTypeInterner& interner, StabsTypeIndex candidate, const InternContext& context, const StabsType& type) {
+	const StabsTypeArena& arena = interner.arena;
+	const StabsTypeArena& source = context.source;
+	const StabsType& other = arena.types[candidate];
+	if(other.descriptor != type.descriptor || other.aux_type != remap_type(context, type.aux_type)) {
+		return false;
+	}
+	switch(type.descriptor) {
+		case StabsTypeDescriptor::TYPE_REFERENCE: {
+			if(type.aux_type != NO_STABS_TYPE) {
+				return true;
+			}
+			s64 shared_number;
+			if(is_named_reference(context, type, shared_number)) {
+				return other.type_reference.type_number == shared_number && interner.reference_files[candidate] == UINT32_MAX;
+			}
+			return other.type_reference.type_number == type.type_reference.type_number
+				&& interner.reference_files[candidate] == context.file;
+		}
+		case StabsTypeDescriptor::ARRAY:
+			return other.array_type.index_type == remap_type(context, type.array_type.index_type)
+				&& other.array_type.element_type == remap_type(context, type.array_type.element_type);
+		case StabsTypeDescriptor::ENUM:
+			if(other.enum_type.value_count != type.enum_type.value_count) {
+				return false;
+			}
+			for(u32 i = 0; i < type.enum_type.value_count; i++) {
+				const StabsEnumValue& lhs = arena.enum_values[other.enum_type.first_value + i];
+				const StabsEnumValue& rhs = source.enum_values[type.enum_type.first_value + i];
+				if(lhs.value != rhs.value || arena.string(lhs.name) != source.string(rhs.name)) {
+					return false;
+				}
+			}
+			return true;
+		case StabsTypeDescriptor::RANGE:
+			return other.range_type.type == remap_type(context, type.range_type.type)
+				&& other.range_type.low == type.range_type.low
+				&& other.range_type.high == type.range_type.high;
+		case StabsTypeDescriptor::STRUCT:
+		case StabsTypeDescriptor::UNION:
+			if(other.struct_type.type_number != type.struct_type.type_number
+				|| other.struct_type.base_class != remap_type(context, type.struct_type.base_class)
+				|| other.struct_type.field_count != type.struct_type.field_count) {
+				return false;
+			}
+			for(u32 i = 0; i < type.struct_type.field_count; i++) {
+				const StabsField& lhs = arena.fields[other.struct_type.first_field + i];
+				const StabsField& rhs = source.fields[type.struct_type.first_field + i];
+				if(lhs.type != remap_type(context, rhs.type) || lhs.offset != rhs.offset || lhs.size != rhs.size
+					|| arena.string(lhs.name) != source.string(rhs.name)
+					|| arena.string(lhs.type_name) != source.string(rhs.type_name)) {
+					return false;
+				}
+			}
+			return true;
+		case StabsTypeDescriptor::POINTER:
+			return other.pointer_type.value_type == remap_type(context, type.pointer_type.value_type);
+		default:
+			return true;
+	}
+}
+
+static StabsTypeIndex remap_type(const InternContext& context, StabsTypeIndex index) {
+	return index != NO_STABS_TYPE ? context.remap[index] : NO_STABS_TYPE;
+}
@@ -0,0 +1,309 @@
+#include "ccc.h"
+
+#include <unordered_set>
+
+struct StructLayout {
+	const StabsTypeArena* arena;
+	const StabsType* type;
+	u64 hash;
+};
+
+static std::vector<std::pair<s64, s64>> pair_files(const SymbolTable& old_symbols, const SymbolTable& new_symbols);
+static void diff_functions(SymbolTableDiff& diff, const SymbolTable& old_symbols, s64 old_index, const SymbolTable& new_symbols, s64 new_index);
+static void diff_globals(SymbolTableDiff& diff, const SymbolTable& old_symbols, const SymbolTable& new_symbols);
+static std::vector<u32> filter_globals(const ExternalSymbolTable& externals);
+static std::string_view external_file_name(const SymbolTable& symbol_table, u32 index);
+static void collect_structs(std::unordered_map<std::string_view, StructLayout>& structs, const StabsFile& file);
+static const StabsType* symbol_struct_type(const StabsFile& file, const StabsSymbol& symbol);
+static u64 hash_struct_layout(const StabsTypeArena& arena, const StabsType& type);
+static void diff_struct_fields(StructDiff& diff, const StructLayout& old_layout, const StructLayout& new_layout);
+
+SymbolTableDiff diff_symbol_tables(const IncrementalSymbolTable& old_table, const IncrementalSymbolTable& new_table) {
+	StatsScope scope("diff symbol tables");
+	SymbolTableDiff diff;
+	const SymbolTable& old_symbols = old_table.symbol_table;
+	const SymbolTable& new_symbols = new_table.symbol_table;
+	std::unordered_map<std::string_view, StructLayout> old_structs;
+	std::unordered_map<std::string_view, StructLayout> new_structs;
+	std::vector<s64> unchanged_stabs_files;
+	for(auto [old_index, new_index] : pair_files(old_symbols, new_symbols)) {
+		const FileDescriptorHash* old_hash = old_index >= 0 ? &old_table.file_hashes[old_index] : nullptr;
+		const FileDescriptorHash* new_hash = new_index >= 0 ? &new_table.file_hashes[new_index] : nullptr;
+		bool same_contents = old_hash && new_hash && old_hash->contents != 0 && old_hash->contents == new_hash->contents;
+		bool same_names = old_hash && new_hash && old_hash->names != 0 && old_hash->names == new_hash->names;
+		if(same_contents) {
+			diff.unchanged_file_count++;
+		} else {
+			diff_functions(diff, old_symbols, old_index, new_symbols, new_index);
+		}
+		if(same_names) {
+			unchanged_stabs_files.push_back(new_index);
+		} else {
+			if(old_index >= 0) {
+				collect_structs(old_structs, *old_table.stabs_files[old_index]);
+			}
+			if(new_index >= 0) {
+				collect_structs(new_structs, *new_table.stabs_files[new_index]);
+			}
+		}
+	}
+	diff_globals(diff, old_symbols, new_symbols);
+	
+	std::vector<StructDiff> added_or_removed;
+	for(auto& [name, layout] : new_structs) {
+		auto old_layout = old_structs.find(name);
+		if(old_layout == old_structs.end()) {
+			added_or_removed.push_back({DiffChange::ADDED, name, {}});
+		} else if(old_layout->second.hash != layout.hash) {
+			StructDiff struct_diff{DiffChange::CHANGED, name, {}};
+			diff_struct_fields(struct_diff, old_layout->second, layout);
+			// Fields that were only reordered within a union don't count.
+			if(!struct_diff.fields.empty()) {
+				diff.structs.emplace_back(std::move(struct_diff));
+			}
+		}
+	}
+	for(auto& [name, layout] : old_structs) {
+		if(new_structs.find(name) == new_structs.end()) {
+			added_or_removed.push_back({DiffChange::REMOVED, name, {}});
+		}
+	}
+	if(!added_or_removed.empty()) {
+		// A struct that's only on one side in the files that changed may still
+		// be defined in one of the files that didn't.
+		std::unordered_set<std::string_view> unchanged_names;
+		for(s64 index : unchanged_stabs_files) {
+			const StabsFile& file = *new_table.stabs_files[index];
+			for(const StabsSymbol& symbol : file.symbols) {
+				if(symbol_struct_type(file, symbol)) {
+					unchanged_names.emplace(file.arena.string(symbol.name));
+				}
+			}
+		}
+		for(StructDiff& struct_diff : added_or_removed) {
+			if(unchanged_names.find(struct_diff.name) == unchanged_names.end()) {
+				diff.structs.emplace_back(std::move(struct_diff));
+			}
+		}
+	}
+	
+	auto by_name = [](const auto& lhs, const auto& rhs) {
+		return lhs.name < rhs.name || (lhs.name == rhs.name && lhs.change < rhs.change);
+	};
+	std::sort(diff.functions.begin(), diff.functions.end(), [&](const SymbolDiff& lhs, const SymbolDiff& rhs) {
+		return lhs.file < rhs.file || (lhs.file == rhs.file && by_name(lhs, rhs));
+	});
+	std::sort(diff.globals.begin(), diff.globals.end(), by_name);
+	std::sort(diff.structs.begin(), diff.structs.end(), by_name);
+	add_stats_counter("unchanged files", diff.unchanged_file_count);
+	return diff;
+}
+
+const char* diff_change(DiffChange change) {
+	switch(change) {
+		case DiffChange::ADDED: return "added";
+		case DiffChange::REMOVED: return "removed";
+		case DiffChange::CHANGED: return "changed";
+	}
+	return nullptr;
+}
+
+static std::vector<std::pair<s64, s64>> pair_files(const SymbolTable& old_symbols, const SymbolTable& new_symbols) {
+	std::vector<std::pair<s64, s64>> pairs;
+	// Normally the list of files doesn't change between builds.
+	bool same_files = old_symbols.files.size() == new_symbols.files.size();
+	for(u64 i = 0; same_files && i < new_symbols.files.size(); i++) {
+		same_files = old_symbols.files[i].name == new_symbols.files[i].name;
+	}
+	if(same_files) {
+		for(s64 i = 0; i < (s64) new_symbols.files.size(); i++) {
+			pairs.emplace_back(i, i);
+		}
+		return pairs;
+	}
+	
+	// If there are several files with the same name, they're paired up in the
+	// order they appear in.
+	std::unordered_map<std::string_view, std::vector<s64>> old_files;
+	for(s64 i = (s64) old_symbols.files.size() - 1; i >= 0; i--) {
+		old_files[old_symbols.files[i].name].push_back(i);
+	}
+	std::vector<bool> paired(old_symbols.files.size(), false);
+	for(s64 i = 0; i < (s64) new_symbols.files.size(); i++) {
+		auto iterator = old_files.find(new_symbols.files[i].name);
+		if(iterator != old_files.end() && !iterator->second.empty()) {
+			s64 old_index = iterator->second.back();
+			iterator->second.pop_back();
+			paired[old_index] = true;
+			pairs.emplace_back(old_index, i);
+		} else {
+			pairs.emplace_back(-1, i);
+		}
+	}
+	for(s64 i = 0; i < (s64) old_symbols.files.size(); i++) {
+		if(!paired[i]) {
+			pairs.emplace_back(i, -1);
+		}
+	}
+	return pairs;
+}
+
+static void diff_functions(SymbolTableDiff& diff, const SymbolTable& old_symbols, s64 old_index, const SymbolTable& new_symbols, s64 new_index) {
+	std::unordered_map<std::string_view, const SymProcedureDescriptor*> old_procedures;
+	if(old_index >= 0) {
+		Range range = old_symbols.files[old_index].procedures;
+		for(s32 i = range.low; i < range.high; i++) {
+			old_procedures.emplace(old_symbols.procedures[i].name, &old_symbols.procedures[i]);
+		}
+	}
+	if(new_index >= 0) {
+		std::string_view file = new_symbols.files[new_index].name;
+		Range range = new_symbols.files[new_index].procedures;
+		for(s32 i = range.low; i < range.high; i++) {
+			const SymProcedureDescriptor& pd = new_symbols.procedures[i];
+			auto old_pd = old_procedures.find(pd.name);
+			if(old_pd == old_procedures.end()) {
+				diff.functions.push_back({DiffChange::ADDED, pd.name, file, 0, pd.address});
+				continue;
+			}
+			if(old_pd->second && old_pd->second->address != pd.address) {
+				diff.functions.push_back({DiffChange::CHANGED, pd.name, file, old_pd->second->address, pd.address});
+			}
+			// Mark it as seen, rather than erasing it, so that a function
+			// with a duplicate name isn't reported as being added.
+			old_pd->second = nullptr;
+		}
+	}
+	if(old_index >= 0) {
+		std::string_view file = old_symbols.files[old_index].name;
+		for(auto& [name, pd] : old_procedures) {
+			if(pd) {
+				diff.functions.push_back({DiffChange::REMOVED, name, file, pd->address, 0});
+			}
+		}
+	}
+}
+
+static void diff_globals(SymbolTableDiff& diff, const SymbolTable& old_symbols, const SymbolTable& new_symbols) {
+	// Merge the two lists of names, which are already sorted.
+	const ExternalSymbolTable& old_externals = old_symbols.externals;
+	const ExternalSymbolTable& new_externals = new_symbols.externals;
+	if(old_externals.values == new_externals.values && old_externals.storage_types == new_externals.storage_types
+		&& old_externals.names == new_externals.names) {
+		return;
+	}
+	std::vector<u32> old_globals = filter_globals(old_externals);
+	std::vector<u32> new_globals = filter_globals(new_externals);
+	u64 i = 0;
+	u64 j = 0;
+	while(i < old_globals.size() || j < new_globals.size()) {
+		s32 order;
+		if(i == old_globals.size()) {
+			order = 1;
+		} else if(j == new_globals.size()) {
+			order = -1;
+		} else {
+			order = old_externals.names[old_globals[i]].compare(new_externals.names[new_globals[j]]);
+		}
+		if(order < 0) {
+			u32 index = old_globals[i++];
+			diff.globals.push_back({DiffChange::REMOVED, old_externals.names[index], external_file_name(old_symbols, index), old_externals.values[index], 0});
+		} else if(order > 0) {
+			u32 index = new_globals[j++];
+			diff.globals.push_back({DiffChange::ADDED, new_externals.names[index], external_file_name(new_symbols, index), 0, new_externals.values[index]});
+		} else {
+			u32 old_index = old_globals[i++];
+			u32 new_index = new_globals[j++];
+			if(old_externals.values[old_index] != new_externals.values[new_index]) {
+				diff.globals.push_back({DiffChange::CHANGED, new_externals.names[new_index], external_file_name(new_symbols, new_index),
+					old_externals.values[old_index], new_externals.values[new_index]});
+			}
+		}
+	}
+}
+
+static std::vector<u32> filter_globals(const ExternalSymbolTable& externals) {
+	std::vector<u32> globals;
+	globals.reserve(externals.size());
+	for(u32 index : externals.sorted_by_name) {
+		SymbolType type = (SymbolType) externals.storage_types[index];
+		if(type != SymbolType::PROC && type != SymbolType::STATICPROC) {
+			globals.push_back(index);
+		}
+	}
+	return globals;
+}
+
+static std::string_view external_file_name(const SymbolTable& symbol_table, u32 index) {
+	s16 file = symbol_table.externals.files[index];
+	if(file >= 0 && file < (s64) symbol_table.files.size()) {
+		return symbol_table.files[file].name;
+	}
+	return std::string_view();
+}
+
+static void collect_structs(std::unordered_map<std::string_view, StructLayout>& structs, const StabsFile& file) {
+	for(const StabsSymbol& symbol : file.symbols) {
+		const StabsType* type = symbol_struct_type(file, symbol);
+		if(type) {
+			structs.emplace(file.arena.string(symbol.name), StructLayout{&file.arena, type, hash_struct_layout(file.arena, *type)});
+		}
+	}
+}
+
+static const StabsType* symbol_struct_type(const StabsFile& file, const StabsSymbol& symbol) {
+	// Typedefs that just refer to another named type aren't followed, so each
+	// struct is only reported once.
+	bool is_type = symbol.descriptor == StabsSymbolDescriptor::TYPE_NAME
+		|| symbol.descriptor == StabsSymbolDescriptor::ENUM_STRUCT_OR_TYPE_TAG;
+	if(!is_type || symbol.type == NO_STABS_TYPE || symbol.name.size == 0) {
+		return nullptr;
+	}
+	const StabsType& type = file.arena.type(symbol.type);
+	if(type.descriptor != StabsTypeDescriptor::STRUCT && type.descriptor != StabsTypeDescriptor::UNION) {
+		return nullptr;
+	}
+	return &type;
+}
+
+static u64 hash_struct_layout(const StabsTypeArena& arena, const StabsType& type) {
+	u64 hash = (u64) type.descriptor;
+	for(u32 i = 0; i < type.struct_type.field_count; i++) {
+		const StabsField& field = arena.fields[type.struct_type.first_field + i];
+		std::string_view name = arena.string(field.name);
+		hash = hash_bytes(name.data(), name.size(), hash);
+		hash = hash_combine(hash, field.offset);
+		hash = hash_combine(hash, field.size);
+	}
+	return hash;
+}
+
+static void diff_struct_fields(StructDiff& diff, const StructLayout& old_layout, const StructLayout& new_layout) {
+	const StabsType::StructOrUnion& old_type = old_layout.type->struct_type;
+	const StabsType::StructOrUnion& new_type = new_layout.type->struct_type;
+	std::unordered_map<std::string_view, u32> old_fields;
+	for(u32 i = 0; i < old_type.field_count; i++) {
+		old_fields.emplace(old_layout.arena->string(old_layout.arena->fields[old_type.first_field + i].name), i);
+	}
+	std::vector<bool> matched(old_type.field_count, false);
+	for(u32 i = 0; i < new_type.field_count; i++) {
+		const StabsField& field = new_layout.arena->fields[new_type.first_field + i];
+		std::string_view name = new_layout.arena->string(field.name);
+		auto old_field = old_fields.find(name);
+		if(old_field == old_fields.end() || matched[old_field->second]) {
+			diff.fields.push_back({DiffChange::ADDED, name, 0, 0, field.offset, field.size});
+			continue;
+		}
+		matched[old_field->second] = true;
+		const StabsField& old = old_layout.arena->fields[old_type.first_field + old_field->second];
+		if(old.offset != field.offset || old.size != field.size) {
+			diff.fields.push_back({DiffChange::CHANGED, name, old.offset, old.size, field.offset, field.size});
+		}
+	}
+	for(u32 i = 0; i < old_type.field_count; i++) {
+		if(!matched[i]) {
+			const StabsField& old = old_layout.arena->fields[old_type.first_field + i];
+			diff.fields.push_back({DiffChange::REMOVED, old_layout.arena->string(old.name), old.offset, old.size, 0, 0});
+		}
+	}
+}
@@ -1,5 +1,12 @@
 #include "ccc.h"
 
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
 u64 size_in_bytes(FILE* file) {
 	u64 whence_you_came = ftell(file);
 	fseek(file, 0, SEEK_END);
@@ -9,15 +16,71 @@ u64 size_in_bytes(FILE* file) {
 }
 
 ProgramImage read_program_image(fs::path path) {
-	FILE* file = fopen(path.c_str(), "rb");
-	verify(file, "error: Failed to open file.\n");
-	u64 size = size_in_bytes(file);
-	ProgramImage image;
-	image.bytes.resize(size);
-	verify(fread(image.bytes.data(), size, 1, file) == 1,
+	StatsScope scope("read input file");
+	FILE* raw_file = fopen(path.c_str(), "rb");
+	verify(raw_file, "error: Failed to open file.\n");
+	// The verify below can throw if errors are being recovered from.
+	std::shared_ptr<FILE> file(raw_file, fclose);
+	u64 size = size_in_bytes(file.get());
+	// Not using a std::vector here since we don't want to zero fill it.
+	std::shared_ptr<u8[]> buffer(new u8[size]);
+	verify(size == 0 || fread(buffer.get(), size, 1, file.get()) == 1,
 		"error: Failed to read file.\n");
-	fclose(file);
+	ProgramImage image;
+	image.bytes = ByteSpan(buffer.get(), size);
+	image.storage = std::move(buffer);
+	return image;
+}
+
+ProgramImage map_program_image(fs::path path) {
+	StatsScope scope("map input file");
+#ifdef _WIN32
+	return read_program_image(path);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	verify(fd != -1, "error: Failed to open file.\n");
+	struct stat info;
+	if(fstat(fd, &info) != 0) {
+		close(fd);
+		verify_not_reached("error: Failed to stat file.\n");
+	}
+	u64 size = info.st_size;
+	if(!S_ISREG(info.st_mode) || size == 0) {
+		close(fd);
+		return read_program_image(path);
+	}
+	void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(address == MAP_FAILED) {
+		return read_program_image(path);
+	}
+	// Most of the file (code, data) is never looked at, so don't read ahead.
+	madvise(address, size, MADV_RANDOM);
+	ProgramImage image;
+	image.bytes = ByteSpan((const u8*) address, size);
+	image.storage = std::shared_ptr<const void>(address, [size](const void* ptr) {
+		munmap((void*) ptr, size);
+	});
 	return image;
+#endif
+}
+
+void prefetch_program_section(const ProgramImage& image, const ProgramSection& section) {
+#ifndef _WIN32
+	if(!image.bytes.contains(section.file_offset, 0)) {
+		return;
+	}
+	u64 page_size = sysconf(_SC_PAGESIZE);
+	u64 end_offset = std::min(section.file_offset + section.size, image.bytes.end_offset());
+	uintptr_t begin = (uintptr_t) &image.bytes[section.file_offset] & ~(page_size - 1);
+	uintptr_t end = (uintptr_t) (image.bytes.data() + (end_offset - image.bytes.base));
+	if(begin < (uintptr_t) image.bytes.data()) {
+		// Heap allocated images aren't page aligned, but they're already in
+		// memory anyway.
+		return;
+	}
+	madvise((void*) begin, end - begin, MADV_WILLNEED);
+#endif
 }
 
 enum class ElfIdentClass : u8 {
@@ -34,6 +97,8 @@ enum class ElfFileType : u16 {
 	LOOS   = 0xfe00,
 	HIOS   = 0xfeff,
 	LOPROC = 0xff00,
+	// PS2 IOP modules (.irx files).
+	SCE_IOPRELEXEC = 0xff80,
 	HIPROC = 0xffff
 };
 
@@ -114,20 +179,44 @@ packed_struct(ElfSectionHeader32,
 	u32 entsize;         // 0x24
 )
 
-void parse_elf_file(Program& program, u64 image_index) {
-	const ProgramImage& image = program.images[image_index];
-	
-	const auto& ident = get_packed<ElfIdentHeader>(image.bytes, 0, "ELF ident bytes");
+static bool is_supported_file_type(ElfFileType type) {
+	return type == ElfFileType::EXEC || type == ElfFileType::REL || type == ElfFileType::SCE_IOPRELEXEC;
+}
+
+static const ElfFileHeader32& parse_elf_file_header(ByteSpan bytes) {
+	const auto& ident = get_packed<ElfIdentHeader>(bytes, 0, "ELF ident bytes");
 	verify(memcmp(ident.magic, "\x7f\x45\x4c\x46", 4) == 0, "error: Invalid ELF file.\n");
 	verify(ident.e_class == ElfIdentClass::B32, "error: Wrong ELF class (not 32 bit).\n");
 	
-	const auto& header = get_packed<ElfFileHeader32>(image.bytes, sizeof(ElfIdentHeader), "ELF file header");
-	verify(header.type == ElfFileType::EXEC, "error: ELF is not an executable.\n");
+	const auto& header = get_packed<ElfFileHeader32>(bytes, sizeof(ElfIdentHeader), "ELF file header");
+	verify(is_supported_file_type(header.type), "error: ELF is not an executable, object file or IOP module.\n");
 	verify(header.machine == ElfMachine::MIPS, "error: Wrong architecture.\n");
-	
+	return header;
+}
+
+bool is_supported_elf_file(fs::path path) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if(!file) {
+		return false;
+	}
+	u8 header_bytes[sizeof(ElfIdentHeader) + sizeof(ElfFileHeader32)];
+	bool read = fread(header_bytes, sizeof(header_bytes), 1, file) == 1;
+	fclose(file);
+	if(!read) {
+		return false;
+	}
+	const auto& ident = *(const ElfIdentHeader*) header_bytes;
+	const auto& header = *(const ElfFileHeader32*) &header_bytes[sizeof(ElfIdentHeader)];
+	return memcmp(ident.magic, "\x7f\x45\x4c\x46", 4) == 0
+		&& ident.e_class == ElfIdentClass::B32
+		&& is_supported_file_type(header.type)
+		&& header.machine == ElfMachine::MIPS;
+}
+
+static void parse_section_headers(Program& program, ByteSpan bytes, const ElfFileHeader32& header, u64 image_index) {
 	for(u32 i = 0; i < header.shnum; i++) {
 		u64 offset = header.shoff + i * sizeof(ElfSectionHeader32);
-		const auto& section_header = get_packed<ElfSectionHeader32>(image.bytes, offset, "ELF section header");
+		const auto& section_header = get_packed<ElfSectionHeader32>(bytes, offset, "ELF section header");
 		ProgramSection section;
 		section.image = image_index;
 		section.file_offset = section_header.offset;
@@ -141,3 +230,64 @@ void parse_elf_file(Program& program, u64 image_index) {
 		program.sections.emplace_back(section);
 	}
 }
+
+void parse_elf_file(Program& program, u64 image_index) {
+	StatsScope scope("parse elf file");
+	const ProgramImage& image = program.images[image_index];
+	const ElfFileHeader32& header = parse_elf_file_header(image.bytes);
+	parse_section_headers(program, image.bytes, header, image_index);
+}
+
+static void read_file_range(FILE* file, u8* dest, u64 file_offset, u64 size) {
+#ifdef _WIN32
+	verify(fseek(file, file_offset, SEEK_SET) == 0 && fread(dest, size, 1, file) == 1,
+		"error: Failed to read file.\n");
+#else
+	int fd = fileno(file);
+	while(size > 0) {
+		ssize_t bytes_read = pread(fd, dest, size, file_offset);
+		verify(bytes_read > 0, "error: Failed to read file.\n");
+		dest += bytes_read;
+		file_offset += bytes_read;
+		size -= bytes_read;
+	}
+#endif
+}
+
+void read_elf_headers(Program& program, fs::path path) {
+	StatsScope scope("read elf headers");
+	FILE* file = fopen(path.c_str(), "rb");
+	verify(file, "error: Failed to open file.\n");
+	program.file = std::shared_ptr<FILE>(file, fclose);
+	
+	u8 header_bytes[sizeof(ElfIdentHeader) + sizeof(ElfFileHeader32)];
+	verify(size_in_bytes(file) >= sizeof(header_bytes), "error: Failed to read ELF file header.\n");
+	read_file_range(file, header_bytes, 0, sizeof(header_bytes));
+	ElfFileHeader32 header = parse_elf_file_header(ByteSpan(header_bytes, sizeof(header_bytes)));
+	
+	// The section header table is only needed while the headers are being
+	// parsed, so it doesn't get its own image.
+	u64 section_headers_size = header.shnum * sizeof(ElfSectionHeader32);
+	verify(size_in_bytes(file) >= header.shoff + section_headers_size, "error: Failed to read ELF section header.\n");
+	std::vector<u8> section_headers(section_headers_size);
+	read_file_range(file, section_headers.data(), header.shoff, section_headers_size);
+	parse_section_headers(program, ByteSpan(section_headers.data(), section_headers_size, header.shoff), header, NO_IMAGE);
+}
+
+u64 read_program_range(Program& program, u64 file_offset, u64 size) {
+	verify(program.file != nullptr, "error: No file to read from.\n");
+	verify(size_in_bytes(program.file.get()) >= file_offset + size, "error: Failed to read file.\n");
+	std::shared_ptr<u8[]> buffer(new u8[size]);
+	read_file_range(program.file.get(), buffer.get(), file_offset, size);
+	ProgramImage& image = program.images.emplace_back();
+	image.bytes = ByteSpan(buffer.get(), size, file_offset);
+	image.storage = std::move(buffer);
+	return program.images.size() - 1;
+}
+
+void read_program_section(Program& program, ProgramSection& section) {
+	StatsScope scope("read section");
+	if(section.image == NO_IMAGE) {
+		section.image = read_program_range(program, section.file_offset, section.size);
+	}
+}
@@ -0,0 +1,60 @@
+#include "ccc.h"
+
+static std::vector<s64> match_files(const std::vector<FileDescriptorHash>& hashes, const std::vector<FileDescriptorHash>& previous, bool by_names);
+
+IncrementalSymbolTable parse_symbol_table_incrementally(const ProgramImage& image, const ProgramSection& section, const IncrementalSymbolTable* previous, u32 thread_count) {
+	StatsScope scope("parse symbol table incrementally");
+	IncrementalSymbolTable table;
+	table.file_hashes = hash_file_descriptors(image, section);
+	if(!previous) {
+		table.symbol_table = parse_symbol_table(image, section, thread_count);
+		std::vector<StabsFile> stabs_files = parse_stabs_files(table.symbol_table, thread_count);
+		for(StabsFile& file : stabs_files) {
+			table.stabs_files.emplace_back(std::make_shared<const StabsFile>(std::move(file)));
+		}
+		return table;
+	}
+	
+	std::vector<s64> sources = match_files(table.file_hashes, previous->file_hashes, false);
+	std::vector<s64> stabs_sources = match_files(table.file_hashes, previous->file_hashes, true);
+	table.symbol_table = reparse_symbol_table(previous->symbol_table, sources, image, section, thread_count);
+	{
+		StatsScope stabs_scope("reparse stabs");
+		table.stabs_files.resize(table.symbol_table.files.size());
+		parallel_for(table.stabs_files.size(), thread_count, [&](u64 i) {
+			if(stabs_sources[i] >= 0) {
+				table.stabs_files[i] = previous->stabs_files[stabs_sources[i]];
+			} else {
+				table.stabs_files[i] = std::make_shared<const StabsFile>(parse_stabs_file(table.symbol_table.files[i]));
+			}
+		});
+	}
+	for(u64 i = 0; i < sources.size(); i++) {
+		table.reused_file_count += sources[i] >= 0;
+		table.reused_stabs_file_count += stabs_sources[i] >= 0;
+	}
+	add_stats_counter("reused files", table.reused_file_count);
+	add_stats_counter("reused stabs files", table.reused_stabs_file_count);
+	return table;
+}
+
+static std::vector<s64> match_files(const std::vector<FileDescriptorHash>& hashes, const std::vector<FileDescriptorHash>& previous, bool by_names) {
+	// Match the files up by hash rather than by index, since adding or
+	// removing a file shifts all the ones after it.
+	std::unordered_map<u64, s64> previous_files;
+	for(u64 i = 0; i < previous.size(); i++) {
+		u64 hash = by_names ? previous[i].names : previous[i].contents;
+		if(hash != 0) {
+			previous_files.emplace(hash, (s64) i);
+		}
+	}
+	std::vector<s64> sources(hashes.size(), -1);
+	for(u64 i = 0; i < hashes.size(); i++) {
+		u64 hash = by_names ? hashes[i].names : hashes[i].contents;
+		auto iterator = previous_files.find(hash);
+		if(hash != 0 && iterator != previous_files.end()) {
+			sources[i] = iterator->second;
+		}
+	}
+	return sources;
+}
@@ -0,0 +1,38 @@
+#include "ccc.h"
+
+void init_lazy_symbol_table(LazySymbolTable& table, const ProgramImage& image, const ProgramSection& section) {
+	table.symbol_table = parse_file_descriptor_table(image, section);
+	table.image = image;
+	table.section = section;
+	u64 file_count = table.symbol_table.files.size();
+	table.symbols_parsed = std::make_unique<std::once_flag[]>(file_count);
+	table.stabs_parsed = std::make_unique<std::once_flag[]>(file_count);
+	table.stabs_files.clear();
+	table.stabs_files.resize(file_count);
+}
+
+const SymFileDescriptor& lazy_file(LazySymbolTable& table, s64 index) {
+	verify(index >= 0 && index < (s64) table.symbol_table.files.size(), "error: File descriptor index out of range.\n");
+	std::call_once(table.symbols_parsed[index], [&]() {
+		parse_file_symbols(table.symbol_table, table.image, table.section, index);
+	});
+	return table.symbol_table.files[index];
+}
+
+const StabsFile& lazy_stabs_file(LazySymbolTable& table, s64 index) {
+	const SymFileDescriptor& fd = lazy_file(table, index);
+	std::call_once(table.stabs_parsed[index], [&]() {
+		table.stabs_files[index] = parse_stabs_file(fd);
+	});
+	return table.stabs_files[index];
+}
+
+s64 find_lazy_file(const LazySymbolTable& table, std::string_view name) {
+	const std::vector<SymFileDescriptor>& files = table.symbol_table.files;
+	for(size_t i = 0; i < files.size(); i++) {
+		if(files[i].name == name) {
+			return i;
+		}
+	}
+	return -1;
+}
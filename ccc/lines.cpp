@@ -0,0 +1,94 @@
+#include "ccc.h"
+
+static void decode_procedure(ProcedureLineNumbers& dest, const LineNumberTable& table, s64 procedure);
+
+void init_line_number_table(LineNumberTable& table, const SymbolTable& symbol_table, const ProgramImage& image) {
+	table.symbol_table = &symbol_table;
+	table.bytes = image.bytes;
+	table.decoded = std::make_unique<std::once_flag[]>(symbol_table.procedures.size());
+	table.procedures.clear();
+	table.procedures.resize(symbol_table.procedures.size());
+}
+
+const ProcedureLineNumbers& procedure_line_numbers(LineNumberTable& table, s64 procedure) {
+	std::call_once(table.decoded[procedure], [&]() {
+		decode_procedure(table.procedures[procedure], table, procedure);
+	});
+	return table.procedures[procedure];
+}
+
+static void decode_procedure(ProcedureLineNumbers& dest, const LineNumberTable& table, s64 procedure) {
+	const SymbolTable& symbol_table = *table.symbol_table;
+	const SymProcedureDescriptor& pd = symbol_table.procedures[procedure];
+	dest.end_address = pd.address;
+	if(pd.file < 0 || pd.file >= (s32) symbol_table.files.size()) {
+		return;
+	}
+	const SymFileDescriptor& fd = symbol_table.files[pd.file];
+	
+	// The line numbers for a procedure continue until the ones for the next
+	// procedure in the same file start.
+	s64 end = fd.line_table_size;
+	for(s32 i = fd.procedures.low; i < fd.procedures.high; i++) {
+		s32 offset = symbol_table.procedures[i].line_table_offset;
+		if(offset > pd.line_table_offset && offset < end) {
+			end = offset;
+		}
+	}
+	u64 file_offset = symbol_table.line_number_table_offset + fd.line_table_offset;
+	u64 begin_offset = file_offset + pd.line_table_offset;
+	u64 end_offset = file_offset + end;
+	if(end_offset <= begin_offset) {
+		return;
+	}
+	verify(table.bytes.contains(begin_offset, end_offset - begin_offset), "error: Line number table out of range.\n");
+	
+	// Each byte holds a signed line delta in the high nibble and the number of
+	// instructions minus one in the low nibble. A delta of -8 means the real
+	// delta follows as a big endian 16 bit value.
+	u32 address = pd.address;
+	s32 line = pd.lines.low;
+	for(u64 offset = begin_offset; offset < end_offset;) {
+		u8 value = table.bytes[offset++];
+		s32 delta = (s8) value >> 4;
+		u32 count = (value & 0xf) + 1;
+		if(delta == -8) {
+			verify(offset + 2 <= end_offset, "error: Line number table truncated.\n");
+			delta = (s16) ((table.bytes[offset] << 8) | table.bytes[offset + 1]);
+			offset += 2;
+		}
+		line += delta;
+		if(dest.lines.empty() || dest.lines.back().line != line) {
+			dest.lines.push_back({address, line});
+		}
+		address += count * 4;
+	}
+	dest.end_address = address;
+}
+
+s32 lookup_line(LineNumberTable& table, const ProcedureAddressIndex& index, u32 address) {
+	s64 procedure = lookup_procedure(index, address);
+	if(procedure < 0) {
+		return -1;
+	}
+	const ProcedureLineNumbers& numbers = procedure_line_numbers(table, procedure);
+	if(numbers.lines.empty() || address >= numbers.end_address) {
+		return -1;
+	}
+	auto iter = std::upper_bound(numbers.lines.begin(), numbers.lines.end(), address,
+		[](u32 lhs, const SymLineNumber& rhs) { return lhs < rhs.address; });
+	return iter != numbers.lines.begin() ? (iter - 1)->line : -1;
+}
+
+std::vector<u32> lookup_line_addresses(LineNumberTable& table, s32 file, s32 line) {
+	std::vector<u32> addresses;
+	const SymFileDescriptor& fd = table.symbol_table->files.at(file);
+	for(s32 i = fd.procedures.low; i < fd.procedures.high; i++) {
+		for(const SymLineNumber& number : procedure_line_numbers(table, i).lines) {
+			if(number.line == line) {
+				addresses.push_back(number.address);
+			}
+		}
+	}
+	return addresses;
+}
@@ -55,6 +55,13 @@ packed_struct(SymbolEntry,
 )
 static_assert(sizeof(SymbolEntry) == 0xc);
 
+packed_struct(ExternalSymbolEntry,
+	u16 flags;        // 0x0
+	s16 ifd;          // 0x2
+	SymbolEntry asym; // 0x4
+)
+static_assert(sizeof(ExternalSymbolEntry) == 0x10);
+
 packed_struct(FileDescriptorEntry,
 	u32 adr;              // 0x00
 	s32 rss;              // 0x04
@@ -66,7 +73,7 @@ packed_struct(FileDescriptorEntry,
 	s32 cline;            // 0x1c
 	s32 iopt_base;        // 0x20
 	s32 copt;             // 0x24
-	s16 ipd_first;        // 0x28
+	u16 ipd_first;        // 0x28
 	s16 cpd;              // 0x2a
 	s32 iaux_base;        // 0x2c
 	s32 caux;             // 0x30
@@ -85,43 +92,587 @@ packed_struct(FileDescriptorEntry,
 )
 static_assert(sizeof(FileDescriptorEntry) == 0x48);
 
-SymbolTable parse_symbol_table(const ProgramImage& image, const ProgramSection& section) {
+// The tables that the symbolic header points to. The extent of each one is
+// checked against the image once up front, so the loops that go over the
+// individual entries don't need to do any bounds checking.
+struct SymbolicTables {
+	const SymbolicHeader* hdrr;
+	PackedSpan<FileDescriptorEntry> files;
+	PackedSpan<ProcedureDescriptorEntry> procedures;
+	PackedSpan<SymbolEntry> symbols;
+	PackedSpan<ExternalSymbolEntry> externals;
+	ByteSpan strings;
+	ByteSpan external_strings;
+};
+
+static SymbolicTables get_symbolic_tables(const ProgramImage& image, const ProgramSection& section);
+static ByteSpan get_string_table(ByteSpan bytes, s32 offset, s32 size, const char* subject);
+static std::vector<s64> find_first_procedures(const SymbolicTables& tables);
+static void parse_file_descriptor(SymFileDescriptor& fd, const SymbolicTables& tables, s64 index, s64 first_procedure);
+static void parse_file_contents(SymbolTable& symbol_table, const SymbolicTables& tables, s64 index, const SymbolFilter& filter = SymbolFilter());
+static bool copy_file_contents(SymbolTable& symbol_table, const SymbolTable& previous, const SymbolicTables& tables, s64 index, s64 source);
+static void parse_local_symbols(SymbolList& symbols, const SymbolicTables& tables, const FileDescriptorEntry& fd_entry, const SymbolFilter& filter = SymbolFilter());
+static void parse_filtered_local_symbols(SymbolList& symbols, const SymbolicTables& tables, PackedSpan<SymbolEntry> entries, const FileDescriptorEntry& fd_entry, const SymbolFilter& filter);
+static void decode_local_symbols(const SymbolEntry* __restrict entries, u64 count, u32* __restrict values, u8* __restrict types, u8* __restrict classes, u32* __restrict indices);
+static void parse_procedure_descriptor(SymProcedureDescriptor& pd, const SymbolicTables& tables, const FileDescriptorEntry& fd_entry, s64 index);
+static void parse_external_symbols(ExternalSymbolTable& externals, const SymbolicTables& tables, const ExternalSymbolTable* previous = nullptr);
+static void index_external_symbol_names(ExternalSymbolTable& externals);
+static void sort_external_symbols_by_value(ExternalSymbolTable& externals);
+static void add_symbol_table_stats(const SymbolTable& symbol_table);
+static void eytzinger_fill(ProcedureAddressIndex& index, const std::vector<u32>& sorted_addresses, u64& next, u64 k);
+
+SymbolTable parse_symbol_table(const ProgramImage& image, const ProgramSection& section, u32 thread_count, const SymbolFilter& filter) {
+	StatsScope scope("parse symbol table");
+	SymbolTable symbol_table = parse_file_descriptor_table(image, section);
+	SymbolicTables tables = get_symbolic_tables(image, section);
+	parallel_for(symbol_table.files.size(), thread_count, [&](u64 i) {
+		parse_file_contents(symbol_table, tables, i, filter);
+	});
+	parse_external_symbols(symbol_table.externals, tables);
+	if(get_stats_collector()) {
+		add_symbol_table_stats(symbol_table);
+	}
+	return symbol_table;
+}
+
+SymbolTable parse_file_descriptor_table(const ProgramImage& image, const ProgramSection& section) {
 	SymbolTable symbol_table;
 	
-	const auto& hdrr = get_packed<SymbolicHeader>(image.bytes, section.file_offset, "MIPS debug section");
-	verify(hdrr.magic == 0x7009, "error: Invalid symbolic header.\n");
-	
+	SymbolicTables tables = get_symbolic_tables(image, section);
+	const SymbolicHeader& hdrr = *tables.hdrr;
+	symbol_table.line_number_table_offset = hdrr.cb_line_offset;
 	symbol_table.procedure_descriptor_table_offset = hdrr.cb_pd_offset;
 	symbol_table.local_symbol_table_offset = hdrr.cb_sym_offset;
 	symbol_table.file_descriptor_table_offset = hdrr.cb_fd_offset;
-	for(s64 i = 0; i < hdrr.ifd_max; i++) {
-		u64 fd_offset = hdrr.cb_fd_offset + i * sizeof(FileDescriptorEntry);
-		const auto& fd_entry = get_packed<FileDescriptorEntry>(image.bytes, fd_offset, "file descriptor");
-		verify(fd_entry.f_big_endian == 0, "error: Not little endian or bad file descriptor table.\n");
-		
-		SymFileDescriptor fd;
-		u64 file_name_offset = hdrr.cb_ss_offset + fd_entry.iss_base + fd_entry.rss;
-		fd.name = read_string(image.bytes, file_name_offset);
-		fd.procedures = {fd_entry.ipd_first, fd_entry.ipd_first + fd_entry.cpd};
-		
-		for(s64 j = 0; j < fd_entry.csym; j++) {
-			u64 sym_offset = hdrr.cb_sym_offset + (fd_entry.isym_base + j) * sizeof(SymbolEntry);
-			const auto& sym_entry = get_packed<SymbolEntry>(image.bytes, sym_offset, "local symbol");
-			
-			Symbol sym;
-			u64 string_offset = hdrr.cb_ss_offset + fd_entry.iss_base + sym_entry.iss;
-			sym.string = read_string(image.bytes, string_offset);
-			sym.value = sym_entry.value;
-			sym.storage_type = (SymbolType) sym_entry.st;
-			sym.storage_class = (SymbolClass) sym_entry.sc;
-			sym.index = sym_entry.index;
-			fd.symbols.emplace_back(sym);
+	symbol_table.storage = image.storage;
+	
+	symbol_table.files.resize(tables.files.size());
+	symbol_table.procedures.resize(tables.procedures.size());
+	std::vector<s64> first_procedures = find_first_procedures(tables);
+	for(u64 i = 0; i < symbol_table.files.size(); i++) {
+		parse_file_descriptor(symbol_table.files[i], tables, i, first_procedures[i]);
+	}
+	
+	return symbol_table;
+}
+
+void parse_file_symbols(SymbolTable& symbol_table, const ProgramImage& image, const ProgramSection& section, s64 index) {
+	verify(index >= 0 && index < (s64) symbol_table.files.size(), "error: File descriptor index out of range.\n");
+	parse_file_contents(symbol_table, get_symbolic_tables(image, section), index);
+}
+
+std::vector<FileDescriptorHash> hash_file_descriptors(const ProgramImage& image, const ProgramSection& section) {
+	StatsScope scope("hash file descriptors");
+	SymbolicTables tables = get_symbolic_tables(image, section);
+	std::vector<s64> first_procedures = find_first_procedures(tables);
+	std::vector<FileDescriptorHash> hashes(tables.files.size());
+	for(u64 i = 0; i < tables.files.size(); i++) {
+		const FileDescriptorEntry& fd_entry = tables.files[i];
+		PackedSpan<SymbolEntry> symbols = tables.symbols.subspan(fd_entry.isym_base, fd_entry.csym, "local symbols");
+		PackedSpan<ProcedureDescriptorEntry> procedures = tables.procedures.subspan(first_procedures[i], fd_entry.cpd, "procedure descriptors");
+		// The string table size isn't checked when parsing, so files with an
+		// invalid one are just never reused.
+		if(fd_entry.iss_base < 0 || fd_entry.cb_ss < 0 || (u64) fd_entry.iss_base + fd_entry.cb_ss > tables.strings.size()) {
+			continue;
 		}
+		u64 names = hash_combine(fd_entry.rss, fd_entry.cb_ss);
+		names = hash_bytes(tables.strings.data() + fd_entry.iss_base, fd_entry.cb_ss, names);
+		for(u64 j = 0; j < symbols.size(); j++) {
+			names = hash_combine(names, ((u64) symbols[j].iss << 16) | (symbols[j].st << 8) | symbols[j].sc);
+		}
+		u64 contents = hash_bytes(symbols.ptr, symbols.size() * sizeof(SymbolEntry), names);
+		contents = hash_bytes(procedures.ptr, procedures.size() * sizeof(ProcedureDescriptorEntry), contents);
+		hashes[i].contents = contents != 0 ? contents : 1;
+		hashes[i].names = names != 0 ? names : 1;
+	}
+	return hashes;
+}
+
+SymbolTable reparse_symbol_table(const SymbolTable& previous, std::vector<s64>& sources, const ProgramImage& image, const ProgramSection& section, u32 thread_count) {
+	StatsScope scope("reparse symbol table");
+	SymbolTable symbol_table = parse_file_descriptor_table(image, section);
+	SymbolicTables tables = get_symbolic_tables(image, section);
+	verify(sources.size() == symbol_table.files.size(), "error: Wrong number of source files for reparse.\n");
+	parallel_for(symbol_table.files.size(), thread_count, [&](u64 i) {
+		if(sources[i] < 0 || !copy_file_contents(symbol_table, previous, tables, i, sources[i])) {
+			sources[i] = -1;
+			parse_file_contents(symbol_table, tables, i);
+		}
+	});
+	parse_external_symbols(symbol_table.externals, tables, &previous.externals);
+	if(get_stats_collector()) {
+		add_symbol_table_stats(symbol_table);
+	}
+	return symbol_table;
+}
+
+void visit_symbol_table(const ProgramImage& image, const ProgramSection& section, const SymbolTableVisitor& visitor, const SymbolFilter& filter) {
+	StatsScope scope("visit symbol table");
+	SymbolicTables tables = get_symbolic_tables(image, section);
+	// These are reused for every file, so the memory used only depends on the
+	// size of the largest file.
+	SymFileDescriptor fd;
+	SymProcedureDescriptor pd;
+	StabsFile stabs_file;
+	s64 next_procedure = 0;
+	for(u64 i = 0; i < tables.files.size(); i++) {
+		const FileDescriptorEntry& fd_entry = tables.files[i];
+		// Same as find_first_procedures.
+		s64 first_procedure = (next_procedure & 0xffff) == fd_entry.ipd_first ? next_procedure : fd_entry.ipd_first;
+		next_procedure = first_procedure + fd_entry.cpd;
 		
-		symbol_table.files.emplace_back(fd);
+		parse_file_descriptor(fd, tables, i, first_procedure);
+		if(!file_matches_filter(filter, fd.name)) {
+			continue;
+		}
+		parse_local_symbols(fd.symbols, tables, fd_entry, filter);
+		if(visitor.file) {
+			visitor.file(i, fd);
+		}
+		if(visitor.symbol) {
+			for(Symbol symbol : fd.symbols) {
+				visitor.symbol(symbol);
+			}
+		}
+		if(visitor.procedure) {
+			for(s64 j = 0; j < fd_entry.cpd; j++) {
+				verify(first_procedure + j < (s64) tables.procedures.size(), "error: Procedure descriptor index out of range.\n");
+				parse_procedure_descriptor(pd, tables, fd_entry, first_procedure + j);
+				pd.file = (s32) i;
+				visitor.procedure(pd);
+			}
+		}
+		if(visitor.stabs_symbol) {
+			stabs_file = parse_stabs_file(fd);
+			for(const StabsSymbol& symbol : stabs_file.symbols) {
+				visitor.stabs_symbol(stabs_file.arena, symbol);
+			}
+		}
 	}
+}
+
+static SymbolicTables get_symbolic_tables(const ProgramImage& image, const ProgramSection& section) {
+	SymbolicTables tables;
+	tables.hdrr = &get_packed<SymbolicHeader>(image.bytes, section.file_offset, "MIPS debug section");
+	const SymbolicHeader& hdrr = *tables.hdrr;
+	verify(hdrr.magic == 0x7009, "error: Invalid symbolic header.\n");
+	tables.files = get_packed_span<FileDescriptorEntry>(image.bytes, hdrr.cb_fd_offset, hdrr.ifd_max, "file descriptor table");
+	tables.procedures = get_packed_span<ProcedureDescriptorEntry>(image.bytes, hdrr.cb_pd_offset, hdrr.ipd_max, "procedure descriptor table");
+	tables.symbols = get_packed_span<SymbolEntry>(image.bytes, hdrr.cb_sym_offset, hdrr.isym_max, "local symbol table");
+	tables.externals = get_packed_span<ExternalSymbolEntry>(image.bytes, hdrr.cb_ext_offset, hdrr.iext_max, "external symbol table");
+	tables.strings = get_string_table(image.bytes, hdrr.cb_ss_offset, hdrr.iss_max, "local string table");
+	tables.external_strings = get_string_table(image.bytes, hdrr.cb_ss_ext_offset, hdrr.iss_ext_max, "external string table");
+	return tables;
+}
+
+static ByteSpan get_string_table(ByteSpan bytes, s32 offset, s32 size, const char* subject) {
+	verify(size >= 0, "error: Failed to read %s.\n", subject);
+	if(size == 0) {
+		return ByteSpan();
+	}
+	verify(offset >= 0 && bytes.contains(offset, size), "error: Failed to read %s.\n", subject);
+	return ByteSpan(&bytes[offset], size, offset);
+}
+
+static std::vector<s64> find_first_procedures(const SymbolicTables& tables) {
+	// The index of the first procedure descriptor is only stored as 16 bits,
+	// so for large programs it wraps around. The procedure descriptors for
+	// each file are stored one after the other though, so we can keep a
+	// running total and use that instead when the low bits match.
+	std::vector<s64> first_procedures(tables.files.size());
+	s64 next = 0;
+	for(u64 i = 0; i < tables.files.size(); i++) {
+		const FileDescriptorEntry& fd_entry = tables.files[i];
+		first_procedures[i] = (next & 0xffff) == fd_entry.ipd_first ? next : fd_entry.ipd_first;
+		next = first_procedures[i] + fd_entry.cpd;
+	}
+	return first_procedures;
+}
+
+static void parse_file_descriptor(SymFileDescriptor& fd, const SymbolicTables& tables, s64 index, s64 first_procedure) {
+	const FileDescriptorEntry& fd_entry = tables.files[index];
+	verify(fd_entry.f_big_endian == 0, "error: Not little endian or bad file descriptor table.\n");
 	
-	return symbol_table;
+	u64 file_name_offset = tables.hdrr->cb_ss_offset + fd_entry.iss_base + fd_entry.rss;
+	fd.name = read_string_view(tables.strings, file_name_offset);
+	fd.procedures = {(s32) first_procedure, (s32) (first_procedure + fd_entry.cpd)};
+	fd.line_table_offset = fd_entry.cb_line_offset;
+	fd.line_table_size = fd_entry.cb_line;
+}
+
+static void parse_file_contents(SymbolTable& symbol_table, const SymbolicTables& tables, s64 index, const SymbolFilter& filter) {
+	SymFileDescriptor& fd = symbol_table.files[index];
+	const FileDescriptorEntry& fd_entry = tables.files[index];
+	
+	if(file_matches_filter(filter, fd.name)) {
+		parse_local_symbols(fd.symbols, tables, fd_entry, filter);
+	}
+	
+	// Each file owns a separate slice of the procedure descriptor table, so
+	// this is safe to do from multiple threads.
+	verify(fd_entry.cpd >= 0 && fd.procedures.low + fd_entry.cpd <= (s64) symbol_table.procedures.size(),
+		"error: Procedure descriptor index out of range.\n");
+	for(s64 j = 0; j < fd_entry.cpd; j++) {
+		s64 pd_index = fd.procedures.low + j;
+		SymProcedureDescriptor& pd = symbol_table.procedures[pd_index];
+		parse_procedure_descriptor(pd, tables, fd_entry, pd_index);
+		pd.file = (s32) index;
+	}
+}
+
+static bool copy_file_contents(SymbolTable& symbol_table, const SymbolTable& previous, const SymbolicTables& tables, s64 index, s64 source) {
+	SymFileDescriptor& fd = symbol_table.files[index];
+	const FileDescriptorEntry& fd_entry = tables.files[index];
+	if(source >= (s64) previous.files.size()) {
+		return false;
+	}
+	const SymFileDescriptor& source_fd = previous.files[source];
+	const SymbolList& source_symbols = source_fd.symbols;
+	if((u64) fd_entry.csym != source_symbols.size()
+		|| fd_entry.cpd != source_fd.procedures.high - source_fd.procedures.low
+		|| fd.procedures.low + fd_entry.cpd > (s64) symbol_table.procedures.size()) {
+		return false;
+	}
+	// Only the file's own string range is covered by the hash, so all of the
+	// names, including their terminators, have to be inside it.
+	u64 names_end = 0;
+	for(u64 j = 0; j < source_symbols.size(); j++) {
+		names_end = std::max(names_end, (u64) source_symbols.name_offsets[j] + source_symbols.name_sizes[j]);
+	}
+	if(source_symbols.size() > 0 && names_end >= (u64) fd_entry.cb_ss) {
+		return false;
+	}
+	
+	fd.symbols = source_symbols;
+	fd.symbols.strings = (const char*) tables.strings.data() + fd_entry.iss_base;
+	for(s64 j = 0; j < fd_entry.cpd; j++) {
+		SymProcedureDescriptor& pd = symbol_table.procedures[fd.procedures.low + j];
+		pd = previous.procedures[source_fd.procedures.low + j];
+		pd.file = (s32) index;
+		// Same as parse_procedure_descriptor.
+		if(pd.symbol_index >= 0 && pd.symbol_index < fd_entry.csym) {
+			pd.name = fd.symbols.name(pd.symbol_index);
+		} else {
+			pd.name = std::string_view();
+		}
+	}
+	return true;
+}
+
+static void parse_local_symbols(SymbolList& symbols, const SymbolicTables& tables, const FileDescriptorEntry& fd_entry, const SymbolFilter& filter) {
+	PackedSpan<SymbolEntry> entries = tables.symbols.subspan(fd_entry.isym_base, fd_entry.csym, "local symbols");
+	u64 strings_offset = tables.hdrr->cb_ss_offset + fd_entry.iss_base;
+	verify(fd_entry.iss_base >= 0 && (u64) fd_entry.iss_base <= tables.strings.size(), "error: Local string table out of range.\n");
+	symbols.strings = (const char*) tables.strings.data() + fd_entry.iss_base;
+	if(filter.types != UINT64_MAX || filter.classes != UINT32_MAX || !filter.name_prefix.empty()) {
+		parse_filtered_local_symbols(symbols, tables, entries, fd_entry, filter);
+		return;
+	}
+	symbols.resize(entries.size());
+	
+	decode_local_symbols(entries.ptr, entries.size(), symbols.values.data(),
+		symbols.storage_types.data(), symbols.storage_classes.data(), symbols.indices.data());
+	
+	// The names are still bounds checked individually, since each one has to
+	// be scanned for its terminator anyway.
+	u64 strings_size = tables.strings.size() - fd_entry.iss_base;
+	for(u64 j = 0; j < entries.size(); j++) {
+		u32 offset = entries[j].iss;
+		verify(offset <= strings_size, "error: Local symbol name out of range.\n");
+		std::string_view string = read_string_view(tables.strings, strings_offset + offset);
+		symbols.name_offsets[j] = offset;
+		symbols.name_sizes[j] = (u32) string.size();
+	}
+}
+
+// Decodes the fixed size fields of a whole file's symbols in one go. The
+// columns are marked as not aliasing each other or the entries, otherwise
+// the compiler has to assume that each store could change the next entry.
+// The bitfields are unpacked by hand since GCC won't vectorise bitfield
+// accesses.
+static void decode_local_symbols(const SymbolEntry* __restrict entries, u64 count, u32* __restrict values, u8* __restrict types, u8* __restrict classes, u32* __restrict indices) {
+	// The entries aren't necessarily aligned, so the words are read with memcpy.
+	const u8* __restrict bytes = (const u8*) entries;
+	for(u64 j = 0; j < count; j++) {
+		u32 value, bits; // st : 6, sc : 5, reserved : 1, index : 20
+		memcpy(&value, bytes + j * sizeof(SymbolEntry) + 4, 4);
+		memcpy(&bits, bytes + j * sizeof(SymbolEntry) + 8, 4);
+		values[j] = value;
+		types[j] = bits & 0x3f;
+		classes[j] = (bits >> 6) & 0x1f;
+		indices[j] = bits >> 12;
+	}
+}
+
+static void parse_filtered_local_symbols(SymbolList& symbols, const SymbolicTables& tables, PackedSpan<SymbolEntry> entries, const FileDescriptorEntry& fd_entry, const SymbolFilter& filter) {
+	// Only the fixed size fields and the first few characters of the name are
+	// looked at before deciding whether to keep a symbol.
+	u64 strings_offset = tables.hdrr->cb_ss_offset + fd_entry.iss_base;
+	u64 strings_size = tables.strings.size() - fd_entry.iss_base;
+	std::string_view prefix = filter.name_prefix;
+	std::vector<u32> matches;
+	for(u64 j = 0; j < entries.size(); j++) {
+		const SymbolEntry& entry = entries[j];
+		if(!((filter.types >> entry.st) & 1) || !((filter.classes >> entry.sc) & 1)) {
+			continue;
+		}
+		if(!prefix.empty()) {
+			verify(entry.iss <= strings_size, "error: Local symbol name out of range.\n");
+			if(strings_size - entry.iss < prefix.size() || memcmp(symbols.strings + entry.iss, prefix.data(), prefix.size()) != 0) {
+				continue;
+			}
+		}
+		matches.push_back((u32) j);
+	}
+	
+	symbols.resize(matches.size());
+	for(u64 k = 0; k < matches.size(); k++) {
+		const SymbolEntry& entry = entries[matches[k]];
+		symbols.values[k] = entry.value;
+		symbols.storage_types[k] = entry.st;
+		symbols.storage_classes[k] = entry.sc;
+		symbols.indices[k] = entry.index;
+		verify(entry.iss <= strings_size, "error: Local symbol name out of range.\n");
+		std::string_view string = read_string_view(tables.strings, strings_offset + entry.iss);
+		symbols.name_offsets[k] = entry.iss;
+		symbols.name_sizes[k] = (u32) string.size();
+	}
+}
+
+static void parse_procedure_descriptor(SymProcedureDescriptor& pd, const SymbolicTables& tables, const FileDescriptorEntry& fd_entry, s64 index) {
+	const ProcedureDescriptorEntry& pd_entry = tables.procedures[index];
+	pd.address = pd_entry.adr;
+	pd.symbol_index = pd_entry.isym;
+	pd.line_index = pd_entry.iline;
+	pd.register_mask = pd_entry.regmask;
+	pd.register_offset = pd_entry.regoffset;
+	pd.float_register_mask = pd_entry.fregmask;
+	pd.float_register_offset = pd_entry.fregoffset;
+	pd.frame_offset = pd_entry.frameoffset;
+	pd.frame_register = pd_entry.framereg;
+	pd.return_register = pd_entry.pcreg;
+	pd.lines = {pd_entry.ln_low, pd_entry.ln_high};
+	pd.line_table_offset = pd_entry.cb_line_offset;
+	if(pd_entry.isym >= 0 && pd_entry.isym < fd_entry.csym) {
+		const SymbolEntry& sym_entry = tables.symbols.subspan(fd_entry.isym_base, fd_entry.csym, "local symbols")[pd_entry.isym];
+		pd.name = read_string_view(tables.strings, tables.hdrr->cb_ss_offset + fd_entry.iss_base + sym_entry.iss);
+	}
+}
+
+static void parse_external_symbols(ExternalSymbolTable& externals, const SymbolicTables& tables, const ExternalSymbolTable* previous) {
+	u64 count = tables.externals.size();
+	externals.names.resize(count);
+	externals.values.resize(count);
+	externals.storage_types.resize(count);
+	externals.storage_classes.resize(count);
+	externals.files.resize(count);
+	for(u64 i = 0; i < count; i++) {
+		const ExternalSymbolEntry& ext_entry = tables.externals[i];
+		externals.values[i] = ext_entry.asym.value;
+		externals.storage_types[i] = ext_entry.asym.st;
+		externals.storage_classes[i] = ext_entry.asym.sc;
+		externals.files[i] = ext_entry.ifd;
+	}
+	for(u64 i = 0; i < count; i++) {
+		u64 name_offset = tables.hdrr->cb_ss_ext_offset + tables.externals[i].asym.iss;
+		externals.names[i] = read_string_view(tables.external_strings, name_offset);
+	}
+	// The indices only depend on the names and the values, so when reparsing
+	// they can often be copied instead of being rebuilt.
+	if(previous && previous->names == externals.names) {
+		externals.name_lookup = previous->name_lookup;
+		externals.sorted_by_name = previous->sorted_by_name;
+	} else {
+		index_external_symbol_names(externals);
+	}
+	if(previous && previous->values == externals.values) {
+		externals.sorted_by_value = previous->sorted_by_value;
+	} else {
+		sort_external_symbols_by_value(externals);
+	}
+}
+
+static void add_symbol_table_stats(const SymbolTable& symbol_table) {
+	u64 symbol_count = 0;
+	u64 symbol_bytes = 0;
+	for(const SymFileDescriptor& fd : symbol_table.files) {
+		symbol_count += fd.symbols.size();
+		symbol_bytes += fd.symbols.memory_usage();
+	}
+	const ExternalSymbolTable& externals = symbol_table.externals;
+	add_stats_counter("file descriptors", symbol_table.files.size());
+	add_stats_counter("local symbols", symbol_count);
+	add_stats_counter("procedure descriptors", symbol_table.procedures.size());
+	add_stats_counter("external symbols", externals.size());
+	add_stats_counter("symbol table bytes", vector_memory_usage(symbol_table.files)
+		+ vector_memory_usage(symbol_table.procedures) + symbol_bytes);
+	add_stats_counter("external symbol table bytes", vector_memory_usage(externals.names)
+		+ vector_memory_usage(externals.values) + vector_memory_usage(externals.storage_types)
+		+ vector_memory_usage(externals.storage_classes) + vector_memory_usage(externals.files)
+		+ vector_memory_usage(externals.name_lookup) + vector_memory_usage(externals.sorted_by_name)
+		+ vector_memory_usage(externals.sorted_by_value));
+}
+
+void SymbolList::resize(u64 size) {
+	values.resize(size);
+	storage_types.resize(size);
+	storage_classes.resize(size);
+	indices.resize(size);
+	name_offsets.resize(size);
+	name_sizes.resize(size);
+}
+
+bool file_matches_filter(const SymbolFilter& filter, std::string_view file_name) {
+	return filter.file_pattern.empty() || match_glob(filter.file_pattern, file_name);
+}
+
+bool symbol_matches_filter(const SymbolFilter& filter, const Symbol& symbol) {
+	return ((filter.types >> (u32) symbol.storage_type) & 1)
+		&& ((filter.classes >> (u32) symbol.storage_class) & 1)
+		&& symbol.string.compare(0, filter.name_prefix.size(), filter.name_prefix) == 0;
+}
+
+void filter_symbols(std::vector<u32>& output, const SymbolList& symbols, SymbolType type, SymbolClass symbol_class) {
+	// Write every index and only advance the output position for the ones
+	// that match, so there's no branch in the loop.
+	u64 count = output.size();
+	output.resize(count + symbols.size());
+	const u8* types = symbols.storage_types.data();
+	const u8* classes = symbols.storage_classes.data();
+	for(u64 i = 0; i < symbols.size(); i++) {
+		output[count] = (u32) i;
+		count += (types[i] == (u8) type) & (classes[i] == (u8) symbol_class);
+	}
+	output.resize(count);
+}
+
+void index_external_symbols(ExternalSymbolTable& externals) {
+	index_external_symbol_names(externals);
+	sort_external_symbols_by_value(externals);
+}
+
+static void index_external_symbol_names(ExternalSymbolTable& externals) {
+	u64 capacity = 16;
+	while(capacity < externals.size() * 2) {
+		capacity *= 2;
+	}
+	externals.name_lookup.assign(capacity, UINT32_MAX);
+	for(u32 i = 0; i < externals.size(); i++) {
+		std::string_view name = externals.names[i];
+		u64 slot = hash_bytes(name.data(), name.size()) & (capacity - 1);
+		while(externals.name_lookup[slot] != UINT32_MAX) {
+			// If there are duplicates, the first one wins.
+			if(externals.names[externals.name_lookup[slot]] == name) {
+				break;
+			}
+			slot = (slot + 1) & (capacity - 1);
+		}
+		if(externals.name_lookup[slot] == UINT32_MAX) {
+			externals.name_lookup[slot] = i;
+		}
+	}
+	
+	externals.sorted_by_name.resize(externals.size());
+	for(u32 i = 0; i < externals.size(); i++) {
+		externals.sorted_by_name[i] = i;
+	}
+	std::stable_sort(externals.sorted_by_name.begin(), externals.sorted_by_name.end(), [&](u32 lhs, u32 rhs) {
+		return externals.names[lhs] < externals.names[rhs];
+	});
+}
+
+static void sort_external_symbols_by_value(ExternalSymbolTable& externals) {
+	externals.sorted_by_value.resize(externals.size());
+	for(u32 i = 0; i < externals.size(); i++) {
+		externals.sorted_by_value[i] = i;
+	}
+	std::stable_sort(externals.sorted_by_value.begin(), externals.sorted_by_value.end(), [&](u32 lhs, u32 rhs) {
+		return externals.values[lhs] < externals.values[rhs];
+	});
+}
+
+s64 lookup_external_symbol(const ExternalSymbolTable& externals, std::string_view name) {
+	if(externals.name_lookup.empty()) {
+		return -1;
+	}
+	u64 mask = externals.name_lookup.size() - 1;
+	for(u64 slot = hash_bytes(name.data(), name.size()) & mask;; slot = (slot + 1) & mask) {
+		u32 index = externals.name_lookup[slot];
+		if(index == UINT32_MAX) {
+			return -1;
+		}
+		if(externals.names[index] == name) {
+			return index;
+		}
+	}
+}
+
+s64 lookup_external_symbol_by_address(const ExternalSymbolTable& externals, u32 address) {
+	auto iter = std::upper_bound(externals.sorted_by_value.begin(), externals.sorted_by_value.end(), address,
+		[&](u32 lhs, u32 rhs) { return lhs < externals.values[rhs]; });
+	return iter != externals.sorted_by_value.begin() ? *(iter - 1) : -1;
+}
+
+std::vector<u32> find_external_symbols_with_prefix(const ExternalSymbolTable& externals, std::string_view prefix) {
+	auto iter = std::lower_bound(externals.sorted_by_name.begin(), externals.sorted_by_name.end(), prefix,
+		[&](u32 lhs, std::string_view rhs) { return externals.names[lhs] < rhs; });
+	std::vector<u32> result;
+	for(; iter != externals.sorted_by_name.end(); iter++) {
+		if(externals.names[*iter].substr(0, prefix.size()) != prefix) {
+			break;
+		}
+		result.push_back(*iter);
+	}
+	return result;
+}
+
+ProcedureAddressIndex build_procedure_address_index(const SymbolTable& symbol_table) {
+	ProcedureAddressIndex index;
+	for(u32 i = 0; i < symbol_table.procedures.size(); i++) {
+		index.sorted_procedures.push_back(i);
+	}
+	std::stable_sort(index.sorted_procedures.begin(), index.sorted_procedures.end(), [&](u32 lhs, u32 rhs) {
+		return symbol_table.procedures[lhs].address < symbol_table.procedures[rhs].address;
+	});
+	std::vector<u32> sorted_addresses;
+	for(u32 procedure : index.sorted_procedures) {
+		sorted_addresses.push_back(symbol_table.procedures[procedure].address);
+	}
+	index.addresses.resize(sorted_addresses.size() + 1);
+	index.ranks.resize(sorted_addresses.size() + 1);
+	u64 next = 0;
+	eytzinger_fill(index, sorted_addresses, next, 1);
+	return index;
+}
+
+static void eytzinger_fill(ProcedureAddressIndex& index, const std::vector<u32>& sorted_addresses, u64& next, u64 k) {
+	// An in-order traversal of the implicit tree visits the slots in sorted
+	// order.
+	if(k < index.addresses.size()) {
+		eytzinger_fill(index, sorted_addresses, next, 2 * k);
+		index.addresses[k] = sorted_addresses[next];
+		index.ranks[k] = (u32) next++;
+		eytzinger_fill(index, sorted_addresses, next, 2 * k + 1);
+	}
+}
+
+s64 lookup_procedure(const ProcedureAddressIndex& index, u32 address) {
+	if(index.addresses.size() <= 1) {
+		return -1;
+	}
+	u64 count = index.addresses.size() - 1;
+	// Find the first address that is greater than the one we're looking for.
+	u64 k = 1;
+	while(k <= count) {
+		k = 2 * k + (index.addresses[k] <= address);
+	}
+	k >>= count_trailing_zeros(~k) + 1;
+	// The procedure we want is the one before it.
+	u64 rank = k != 0 ? index.ranks[k] : count;
+	if(rank == 0) {
+		return -1;
+	}
+	return index.sorted_procedures[rank - 1];
 }
 
 const char* symbol_type(SymbolType type) {
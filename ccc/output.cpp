@@ -0,0 +1,84 @@
+#include "ccc.h"
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+OutputBuffer::~OutputBuffer() {
+	flush_output(*this);
+}
+
+void flush_output(OutputBuffer& out) {
+	if(out.size > 0) {
+		verify(fwrite(out.data.get(), out.size, 1, out.file) == 1, "error: Failed to write output.\n");
+		out.size = 0;
+	}
+}
+
+void write_string(OutputBuffer& out, std::string_view str) {
+	if(out.size + str.size() > out.capacity) {
+		flush_output(out);
+		if(str.size() > out.capacity) {
+			verify(fwrite(str.data(), str.size(), 1, out.file) == 1, "error: Failed to write output.\n");
+			return;
+		}
+	}
+	memcpy(&out.data[out.size], str.data(), str.size());
+	out.size += str.size();
+}
+
+void write_hex(OutputBuffer& out, u64 value, u32 min_digits) {
+	char digits[16];
+	u32 count = 0;
+	do {
+		digits[15 - count++] = HEX_DIGITS[value & 0xf];
+		value >>= 4;
+	} while(value != 0);
+	for(u32 i = count; i < min_digits; i++) {
+		write_char(out, '0');
+	}
+	write_string(out, std::string_view(&digits[16 - count], count));
+}
+
+void write_decimal(OutputBuffer& out, s64 value, u32 min_width) {
+	char digits[20];
+	u32 count = 0;
+	// Negate as unsigned so that INT64_MIN works.
+	u64 magnitude = value < 0 ? 0 - (u64) value : (u64) value;
+	do {
+		digits[19 - count++] = '0' + (magnitude % 10);
+		magnitude /= 10;
+	} while(magnitude != 0);
+	u32 width = count + (value < 0);
+	for(u32 i = width; i < min_width; i++) {
+		write_char(out, ' ');
+	}
+	if(value < 0) {
+		write_char(out, '-');
+	}
+	write_string(out, std::string_view(&digits[20 - count], count));
+}
+
+void write_json_string(OutputBuffer& out, std::string_view str) {
+	write_char(out, '"');
+	u64 begin = 0;
+	for(u64 i = 0; i < str.size(); i++) {
+		u8 c = (u8) str[i];
+		if(c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+		write_string(out, str.substr(begin, i - begin));
+		begin = i + 1;
+		switch(c) {
+			case '"': write_string(out, "\\\""); break;
+			case '\\': write_string(out, "\\\\"); break;
+			case '\n': write_string(out, "\\n"); break;
+			case '\t': write_string(out, "\\t"); break;
+			default: {
+				write_string(out, "\\u00");
+				write_char(out, HEX_DIGITS[c >> 4]);
+				write_char(out, HEX_DIGITS[c & 0xf]);
+			}
+		}
+	}
+	write_string(out, str.substr(begin));
+	write_char(out, '"');
+}
@@ -0,0 +1,391 @@
+#include "ccc.h"
+
+#include <condition_variable>
+
+#ifndef _WIN32
+	#include <csignal>
+	#include <cerrno>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+static void answer_symbol_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view name);
+static void answer_address_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view argument);
+static void answer_type_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view name);
+static void answer_member_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view name, std::string_view argument);
+static bool parse_number(std::string_view str, u64& value);
+static std::string_view next_word(std::string_view& str);
+
+// Connections beyond this wait in the listen backlog until one closes.
+static const u32 MAX_CONNECTION_COUNT = 64;
+
+std::shared_ptr<const SymbolDatabase> load_symbol_database(const fs::path& path, u32 thread_count, const SymbolDatabase* previous) {
+	StatsScope scope("load symbol database");
+	auto database = std::make_shared<SymbolDatabase>();
+	database->path = path;
+	std::error_code error;
+	database->modified = fs::last_write_time(path, error);
+	Program& program = database->program;
+	// The file is read rather than mapped, since it may be overwritten while
+	// the database is still in use, and a mapping of a truncated file faults.
+	program.images.emplace_back(read_program_image(path));
+	parse_elf_file(program, 0);
+	const ProgramSection* mdebug_section = nullptr;
+	for(const ProgramSection& section : program.sections) {
+		if(section.type == ProgramSectionType::MIPS_DEBUG) {
+			mdebug_section = &section;
+		}
+	}
+	verify(mdebug_section, "error: No symbol table in '%s'.\n", path.string().c_str());
+	database->symbols = parse_symbol_table_incrementally(program.images[0], *mdebug_section, previous ? &previous->symbols : nullptr, thread_count);
+	database->procedure_index = build_procedure_address_index(database->symbols.symbol_table);
+	
+	StabsTypeInterner interner;
+	for(const std::shared_ptr<const StabsFile>& file : database->symbols.stabs_files) {
+		database->stabs_files.emplace_back(intern_stabs_file(interner, *file));
+	}
+	database->stabs_arena = std::move(interner.arena);
+	for(u32 i = 0; i < database->stabs_files.size(); i++) {
+		for(const StabsSymbol& symbol : database->stabs_files[i].symbols) {
+			bool is_type = symbol.descriptor == StabsSymbolDescriptor::TYPE_NAME
+				|| symbol.descriptor == StabsSymbolDescriptor::ENUM_STRUCT_OR_TYPE_TAG;
+			if(is_type && symbol.type != NO_STABS_TYPE) {
+				database->types_by_name.emplace(database->stabs_arena.string(symbol.name), NamedStabsType{symbol.type, i});
+			}
+		}
+	}
+	return database;
+}
+
+void answer_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view query) {
+	std::string_view command = next_word(query);
+	std::string_view first = next_word(query);
+	std::string_view second = next_word(query);
+	if(command == "symbol" && !first.empty()) {
+		answer_symbol_query(out, database, first);
+	} else if(command == "address" && !first.empty()) {
+		answer_address_query(out, database, first);
+	} else if(command == "type" && !first.empty()) {
+		answer_type_query(out, database, first);
+	} else if(command == "member" && !second.empty()) {
+		answer_member_query(out, database, first, second);
+	} else {
+		write_string(out, "error invalid query\n");
+	}
+}
+
+static void answer_symbol_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view name) {
+	const SymbolTable& symbol_table = database.symbols.symbol_table;
+	const ExternalSymbolTable& externals = symbol_table.externals;
+	s64 index = lookup_external_symbol(externals, name);
+	if(index < 0) {
+		write_string(out, "error symbol not found\n");
+		return;
+	}
+	const char* type = symbol_type((SymbolType) externals.storage_types[index]);
+	write_string(out, "symbol ");
+	write_string(out, name);
+	write_char(out, ' ');
+	write_hex(out, externals.values[index], 8);
+	write_char(out, ' ');
+	write_string(out, type ? type : "?");
+	write_char(out, ' ');
+	s16 file = externals.files[index];
+	if(file >= 0 && file < (s64) symbol_table.files.size()) {
+		write_string(out, symbol_table.files[file].name);
+	}
+	write_char(out, '\n');
+}
+
+static void answer_address_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view argument) {
+	u64 address;
+	if(!parse_number(argument, address) || address > UINT32_MAX) {
+		write_string(out, "error invalid address\n");
+		return;
+	}
+	s64 index = lookup_procedure(database.procedure_index, (u32) address);
+	if(index < 0) {
+		write_string(out, "error address not found\n");
+		return;
+	}
+	const SymbolTable& symbol_table = database.symbols.symbol_table;
+	const SymProcedureDescriptor& pd = symbol_table.procedures[index];
+	write_string(out, "function ");
+	write_string(out, pd.name);
+	write_char(out, ' ');
+	write_hex(out, pd.address, 8);
+	write_string(out, " +");
+	write_hex(out, address - pd.address);
+	write_char(out, ' ');
+	if(pd.file >= 0 && pd.file < (s32) symbol_table.files.size()) {
+		write_string(out, symbol_table.files[pd.file].name);
+	}
+	write_char(out, '\n');
+}
+
+static void answer_type_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view name) {
+	auto iterator = database.types_by_name.find(name);
+	if(iterator == database.types_by_name.end()) {
+		write_string(out, "error type not found\n");
+		return;
+	}
+	const StabsTypeArena& arena = database.stabs_arena;
+	const StabsTypeNumberIndex& type_numbers = database.stabs_files[iterator->second.file].type_numbers;
+	StabsTypeIndex type_index = resolve_stabs_type(arena, type_numbers, iterator->second.type);
+	if(type_index == NO_STABS_TYPE) {
+		write_string(out, "error type not defined\n");
+		return;
+	}
+	const StabsType& type = arena.type(type_index);
+	write_string(out, "type ");
+	write_string(out, name);
+	write_char(out, ' ');
+	write_char(out, (char) type.descriptor != '\0' ? (char) type.descriptor : '=');
+	write_char(out, '\n');
+	if(type.descriptor == StabsTypeDescriptor::STRUCT || type.descriptor == StabsTypeDescriptor::UNION) {
+		for(u32 i = 0; i < type.struct_type.field_count; i++) {
+			const StabsField& field = arena.fields[type.struct_type.first_field + i];
+			write_string(out, "field ");
+			write_hex(out, field.offset / 8);
+			write_char(out, ' ');
+			write_hex(out, field.size / 8);
+			write_char(out, ' ');
+			write_string(out, arena.string(field.name));
+			write_char(out, '\n');
+		}
+	}
+}
+
+static void answer_member_query(OutputBuffer& out, const SymbolDatabase& database, std::string_view name, std::string_view argument) {
+	u64 offset;
+	if(!parse_number(argument, offset)) {
+		write_string(out, "error invalid offset\n");
+		return;
+	}
+	auto iterator = database.types_by_name.find(name);
+	if(iterator == database.types_by_name.end()) {
+		write_string(out, "error type not found\n");
+		return;
+	}
+	const StabsTypeArena& arena = database.stabs_arena;
+	const StabsTypeNumberIndex& type_numbers = database.stabs_files[iterator->second.file].type_numbers;
+	// Walk down through nested structs and unions until the innermost member
+	// containing the offset is found.
+	std::string path;
+	s64 bit_offset = offset * 8;
+	s64 member_offset = 0;
+	s64 member_size = -1;
+	StabsTypeIndex type_index = resolve_stabs_type(arena, type_numbers, iterator->second.type);
+	while(type_index != NO_STABS_TYPE) {
+		const StabsType& type = arena.type(type_index);
+		if(type.descriptor != StabsTypeDescriptor::STRUCT && type.descriptor != StabsTypeDescriptor::UNION) {
+			break;
+		}
+		const StabsField* member = nullptr;
+		for(u32 i = 0; i < type.struct_type.field_count; i++) {
+			const StabsField& field = arena.fields[type.struct_type.first_field + i];
+			if(bit_offset >= field.offset && bit_offset < field.offset + std::max(field.size, (s64) 1)) {
+				member = &field;
+				break;
+			}
+		}
+		if(!member) {
+			break;
+		}
+		if(!path.empty()) {
+			path += '.';
+		}
+		path += arena.string(member->name);
+		bit_offset -= member->offset;
+		member_offset += member->offset;
+		member_size = member->size;
+		type_index = resolve_stabs_type(arena, type_numbers, member->type);
+	}
+	if(path.empty()) {
+		write_string(out, "error no member at offset\n");
+		return;
+	}
+	write_string(out, "member ");
+	write_string(out, path);
+	write_char(out, ' ');
+	write_hex(out, member_offset / 8);
+	write_char(out, ' ');
+	write_hex(out, member_size / 8);
+	write_char(out, '\n');
+}
+
+static bool parse_number(std::string_view str, u64& value) {
+	std::string string(str);
+	char* end = nullptr;
+	value = strtoull(string.c_str(), &end, 0);
+	return !string.empty() && *end == '\0';
+}
+
+static std::string_view next_word(std::string_view& str) {
+	u64 begin = str.find_first_not_of(" \t\r\n");
+	if(begin == std::string_view::npos) {
+		str = {};
+		return {};
+	}
+	u64 end = str.find_first_of(" \t\r\n", begin);
+	std::string_view word = str.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin);
+	str = end == std::string_view::npos ? std::string_view() : str.substr(end);
+	return word;
+}
+
+void init_symbol_server(SymbolServer& server, const std::vector<fs::path>& paths, u32 thread_count) {
+	server.paths = paths;
+	server.thread_count = thread_count;
+	server.databases.clear();
+	server.failed_modified.assign(paths.size(), fs::file_time_type());
+	for(const fs::path& path : paths) {
+		server.databases.emplace_back(load_symbol_database(path, thread_count));
+	}
+}
+
+u32 reload_modified_databases(SymbolServer& server) {
+	u32 reloaded = 0;
+	for(size_t i = 0; i < server.paths.size(); i++) {
+		std::shared_ptr<const SymbolDatabase> database;
+		{
+			std::lock_guard<std::mutex> lock(server.mutex);
+			database = server.databases[i];
+		}
+		std::error_code error;
+		fs::file_time_type modified = fs::last_write_time(server.paths[i], error);
+		if(error || modified == database->modified || modified == server.failed_modified[i]) {
+			continue;
+		}
+		// The new database is built without holding the lock, and queries
+		// that are already running keep their reference to the old one.
+		std::shared_ptr<const SymbolDatabase> new_database;
+		try {
+			VerifyRecoveryScope recovery;
+			new_database = load_symbol_database(server.paths[i], server.thread_count, database.get());
+		} catch(VerifyFailure& failure) {
+			// The file may still be being written, so keep serving the old
+			// version until the next modification.
+			fprintf(stderr, "warning: Failed to reload '%s': %s\n", server.paths[i].string().c_str(), failure.message.c_str());
+			server.failed_modified[i] = modified;
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(server.mutex);
+		server.databases[i] = std::move(new_database);
+		reloaded++;
+	}
+	return reloaded;
+}
+
+void answer_server_query(OutputBuffer& out, SymbolServer& server, std::string_view query) {
+	std::vector<std::shared_ptr<const SymbolDatabase>> databases;
+	{
+		std::lock_guard<std::mutex> lock(server.mutex);
+		databases = server.databases;
+	}
+	for(const std::shared_ptr<const SymbolDatabase>& database : databases) {
+		if(databases.size() > 1) {
+			write_string(out, "image ");
+			write_string(out, database->path.string());
+			write_char(out, '\n');
+		}
+		answer_query(out, *database, query);
+	}
+	write_string(out, "end\n");
+}
+
+bool serve_queries(SymbolServer& server, FILE* input, FILE* output) {
+	OutputBuffer out(output, 64 * 1024);
+	std::string line;
+	char buffer[1024];
+	while(fgets(buffer, sizeof(buffer), input)) {
+		line += buffer;
+		if(line.back() != '\n' && !feof(input)) {
+			continue;
+		}
+		try {
+			// A client that goes away mid reply shouldn't stop the server.
+			VerifyRecoveryScope recovery;
+			answer_server_query(out, server, line);
+			flush_output(out);
+		} catch(VerifyFailure&) {
+			// Drop whatever is left so the destructor doesn't try again.
+			out.size = 0;
+			return false;
+		}
+		if(fflush(output) != 0) {
+			return false;
+		}
+		line.clear();
+	}
+	return true;
+}
+
+void serve_queries_on_socket(SymbolServer& server, const fs::path& socket_path) {
+#ifdef _WIN32
+	verify_not_reached("error: Unix domain sockets aren't supported on this platform.\n");
+#else
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	verify(listener != -1, "error: Failed to create socket.\n");
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	std::string path = socket_path.string();
+	verify(path.size() < sizeof(address.sun_path), "error: Socket path too long.\n");
+	memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	unlink(path.c_str());
+	verify(bind(listener, (sockaddr*) &address, sizeof(address)) == 0, "error: Failed to bind socket.\n");
+	verify(listen(listener, 16) == 0, "error: Failed to listen on socket.\n");
+	// Writing to a connection that the client has closed raises SIGPIPE,
+	// which would otherwise kill the server along with every other client.
+	signal(SIGPIPE, SIG_IGN);
+	// Shared with the connection threads, which are detached.
+	struct ConnectionCount {
+		std::mutex mutex;
+		std::condition_variable closed;
+		u32 count = 0;
+	};
+	auto connections = std::make_shared<ConnectionCount>();
+	u32 backoff_ms = 0;
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> lock(connections->mutex);
+			connections->closed.wait(lock, [&]() { return connections->count < MAX_CONNECTION_COUNT; });
+		}
+		int connection = accept(listener, nullptr, nullptr);
+		if(connection == -1) {
+			// Errors like running out of file descriptors won't go away
+			// straight away, so don't spin on them.
+			if(errno != EINTR) {
+				backoff_ms = std::min(std::max(backoff_ms * 2, 10u), 1000u);
+				std::this_thread::sleep_for(std::chrono::milliseconds(backoff_ms));
+			}
+			continue;
+		}
+		backoff_ms = 0;
+		{
+			std::lock_guard<std::mutex> lock(connections->mutex);
+			connections->count++;
+		}
+		std::thread([&server, connection, connections]() {
+			FILE* input = fdopen(connection, "r");
+			FILE* output = fdopen(dup(connection), "w");
+			if(input && output) {
+				serve_queries(server, input, output);
+			}
+			if(input) {
+				fclose(input);
+			} else {
+				close(connection);
+			}
+			if(output) {
+				fclose(output);
+			}
+			{
+				std::lock_guard<std::mutex> lock(connections->mutex);
+				connections->count--;
+			}
+			connections->closed.notify_one();
+		}).detach();
+	}
+#endif
+}
@@ -1,20 +1,98 @@
 #include "ccc.h"
 
-static StabsType parse_type(const char*& input);
-static std::vector<StabsField> parse_field_list(const char*& input);
+static void collect_stabs_strings(StabsFile& file, const SymFileDescriptor& fd, std::vector<u32>& stabs_indices, std::string_view name_prefix = std::string_view());
+static void parse_stabs_strings(StabsFile& file);
+static StabsTypeIndex parse_type(const char*& input, StabsTypeArena& arena);
+static void parse_field_list(const char*& input, StabsTypeArena& arena, StabsType::StructOrUnion& dest);
 static s8 eat_s8(const char*& input);
-static s64 eat_s64_literal(const char*& input);
-static std::string eat_identifier(const char*& input);
 static void expect_s8(const char*& input, s8 expected, const char* subject);
 static void validate_symbol_descriptor(StabsSymbolDescriptor descriptor);
-static void print_field(const StabsField& field);
+static void visit_nested_fields(const StabsTypeArenaView& arena, StabsTypeIndex type_index, const std::function<void(const StabsField& field)>& func);
+static void print_field(const StabsTypeArenaView& arena, const StabsField& field);
 
 static const char* ERR_END_OF_INPUT =
 	"error: Unexpected end of input while parsing STAB type.\n";
 
-StabsSymbol parse_stabs_symbol(const char* input) {
+StabsString StabsTypeArena::add_string(std::string_view str) {
+	StabsString result;
+	result.offset = (u32) strings.size();
+	result.size = (u32) str.size();
+	strings.insert(strings.end(), str.begin(), str.end());
+	return result;
+}
+
+std::vector<StabsFile> parse_stabs_files(const SymbolTable& symbol_table, u32 thread_count, std::string_view name_prefix) {
+	StatsScope scope("parse stabs");
+	std::vector<StabsFile> files(symbol_table.files.size());
+	// First collect the full strings, so that the parsing itself can be split
+	// up evenly between threads.
+	std::vector<u32> stabs_indices;
+	for(size_t i = 0; i < symbol_table.files.size(); i++) {
+		collect_stabs_strings(files[i], symbol_table.files[i], stabs_indices, name_prefix);
+	}
+	parallel_for(files.size(), thread_count, [&](u64 i) {
+		parse_stabs_strings(files[i]);
+	});
+	if(get_stats_collector()) {
+		u64 string_count = 0;
+		u64 type_count = 0;
+		u64 arena_bytes = 0;
+		for(const StabsFile& file : files) {
+			string_count += file.strings.size();
+			type_count += file.arena.types.size();
+			arena_bytes += file.arena.memory_usage();
+		}
+		add_stats_counter("stabs strings", string_count);
+		add_stats_counter("stabs types", type_count);
+		add_stats_counter("stabs per-file arena bytes", arena_bytes);
+	}
+	return files;
+}
+
+StabsFile parse_stabs_file(const SymFileDescriptor& fd) {
+	StabsFile file;
+	std::vector<u32> stabs_indices;
+	collect_stabs_strings(file, fd, stabs_indices);
+	parse_stabs_strings(file);
+	return file;
+}
+
+static void collect_stabs_strings(StabsFile& file, const SymFileDescriptor& fd, std::vector<u32>& stabs_indices, std::string_view name_prefix) {
+	std::string prefix;
+	stabs_indices.clear();
+	filter_symbols(stabs_indices, fd.symbols, SymbolType::NIL, (SymbolClass) 0);
+	for(u32 index : stabs_indices) {
+		std::string_view string = fd.symbols.name(index);
+		if(string.find("@") == 0 || string.find("$") == 0 || string.size() == 0) {
+			continue;
+		}
+		// Some STABS symbols are split between multiple strings.
+		if(string[string.size() - 1] == '\\') {
+			prefix += string.substr(0, string.size() - 1);
+		} else if(prefix.empty() && string.compare(0, name_prefix.size(), name_prefix) != 0) {
+			continue;
+		} else {
+			std::string& full_symbol = file.strings.emplace_back(std::move(prefix));
+			full_symbol += string;
+			prefix = "";
+			if(full_symbol.compare(0, name_prefix.size(), name_prefix) != 0) {
+				file.strings.pop_back();
+			}
+		}
+	}
+}
+
+static void parse_stabs_strings(StabsFile& file) {
+	file.symbols.reserve(file.strings.size());
+	for(const std::string& string : file.strings) {
+		file.symbols.emplace_back(parse_stabs_symbol(string.c_str(), file.arena));
+	}
+	file.type_numbers = build_type_number_index(file.arena, file.symbols);
+}
+
+StabsSymbol parse_stabs_symbol(const char* input, StabsTypeArena& arena) {
 	StabsSymbol symbol;
-	symbol.name = eat_identifier(input);
+	symbol.name = arena.add_string(eat_identifier(input));
 	expect_s8(input, ':', "identifier");
 	verify(*input != '\0', ERR_END_OF_INPUT);
 	if(*input >= '0' && *input <= '9') {
@@ -32,11 +110,13 @@ StabsSymbol parse_stabs_symbol(const char* input) {
 		return symbol;
 	}
 	verify(eat_s8(input) == '=', "error: Expected '='.\n");
-	symbol.type = parse_type(input);
+	symbol.type = parse_type(input, arena);
 	return symbol;
 }
 
-static StabsType parse_type(const char*& input) {
+static StabsTypeIndex parse_type(const char*& input, StabsTypeArena& arena) {
+	// The children of a type are added to the arena before the type itself,
+	// so nothing here holds a reference into the arena while parsing them.
 	StabsType type;
 	verify(*input != '\0', ERR_END_OF_INPUT);
 	if(*input >= '0' && *input <= '9') {
@@ -49,15 +129,19 @@ static StabsType parse_type(const char*& input) {
 			type.type_reference.type_number = eat_s64_literal(input);
 			break;
 		case StabsTypeDescriptor::ARRAY:
-			type.array_type.index_type = new StabsType(parse_type(input));
-			type.array_type.element_type = new StabsType(parse_type(input));
+			type.array_type.index_type = parse_type(input, arena);
+			type.array_type.element_type = parse_type(input, arena);
 			break;
 		case StabsTypeDescriptor::ENUM:
+			type.enum_type.first_value = (u32) arena.enum_values.size();
+			type.enum_type.value_count = 0;
 			while(*input != ';') {
-				std::string name = eat_identifier(input);
+				StabsEnumValue value;
+				value.name = arena.add_string(eat_identifier(input));
 				expect_s8(input, ':', "identifier");
-				s64 value = eat_s64_literal(input);
-				type.enum_type.values.emplace_back(name, value);
+				value.value = eat_s64_literal(input);
+				arena.enum_values.emplace_back(value);
+				type.enum_type.value_count++;
 				verify(eat_s8(input) == ',',
 					"error: Expecting ',' while parsing enum, got '%c' (%02hhx).",
 					*input, *input);
@@ -67,7 +151,7 @@ static StabsType parse_type(const char*& input) {
 			eat_s64_literal(input);
 			break;
 		case StabsTypeDescriptor::RANGE:
-			type.range_type.type = new StabsType(parse_type(input));
+			type.range_type.type = parse_type(input, arena);
 			expect_s8(input, ';', "range type descriptor");
 			type.range_type.low = eat_s64_literal(input);
 			expect_s8(input, ';', "low range value");
@@ -76,27 +160,29 @@ static StabsType parse_type(const char*& input) {
 			break;
 		case StabsTypeDescriptor::STRUCT:
 			type.struct_type.type_number = eat_s64_literal(input);
+			type.struct_type.base_class = NO_STABS_TYPE;
 			if(*input == '!') {
 				input++;
 				eat_s64_literal(input);
 				expect_s8(input, ',', "!");
 				eat_s64_literal(input);
 				expect_s8(input, ',', "!");
-				parse_type(input);
+				type.struct_type.base_class = parse_type(input, arena);
 				expect_s8(input, ';', "!");
 			}
-			type.struct_type.fields = parse_field_list(input);
+			parse_field_list(input, arena, type.struct_type);
 			break;
 		case StabsTypeDescriptor::UNION:
 			type.union_type.type_number = eat_s64_literal(input);
-			type.union_type.fields = parse_field_list(input);
+			type.union_type.base_class = NO_STABS_TYPE;
+			parse_field_list(input, arena, type.union_type);
 			break;
 		case StabsTypeDescriptor::AMPERSAND:
 			// Not sure.
 			eat_s64_literal(input);
 			break;
 		case StabsTypeDescriptor::POINTER:
-			type.pointer_type.value_type = new StabsType(parse_type(input));
+			type.pointer_type.value_type = parse_type(input, arena);
 			break;
 		case StabsTypeDescriptor::SLASH:
 			// Not sure.
@@ -111,16 +197,18 @@ static StabsType parse_type(const char*& input) {
 	}
 	if(*input == '=') {
 		input++;
-		type.aux_type = new StabsType(parse_type(input));
+		type.aux_type = parse_type(input, arena);
 	}
-	return type;
+	arena.types.emplace_back(type);
+	return (StabsTypeIndex) (arena.types.size() - 1);
 }
 
-static std::vector<StabsField> parse_field_list(const char*& input) {
-	std::vector<StabsField> fields;
+static void parse_field_list(const char*& input, StabsTypeArena& arena, StabsType::StructOrUnion& dest) {
+	size_t stack_base = arena.field_stack.size();
 	while(*input != '\0') {
 		StabsField field;
-		field.name = eat_identifier(input);
+		std::string_view name = eat_identifier(input);
+		field.name = arena.add_string(name);
 		expect_s8(input, ':', "identifier");
 		if(*input == ':') {
 			// TODO: Parse the last part.
@@ -136,15 +224,15 @@ static std::vector<StabsField> parse_field_list(const char*& input) {
 			}
 			break;
 		}
-		field.type = parse_type(input);
-		if(field.name.size() >= 1 && field.name[0] == '$') {
+		field.type = parse_type(input, arena);
+		if(name.size() >= 1 && name[0] == '$') {
 			// Not sure.
 			expect_s8(input, ',', "field type");
 			field.offset = eat_s64_literal(input);
 			expect_s8(input, ';', "field offset");
 		} else if(*input == ':') {
 			input++;
-			field.type_name = eat_identifier(input);
+			field.type_name = arena.add_string(eat_identifier(input));
 			expect_s8(input, ';', "identifier");
 		} else if(*input == ',') {
 			input++;
@@ -155,14 +243,16 @@ static std::vector<StabsField> parse_field_list(const char*& input) {
 		} else {
 			verify_not_reached("error: Expected ':' or ',', got '%c' (%hhx).", *input, *input);
 		}
-		print_field(field);
-		fields.emplace_back(field);
+		arena.field_stack.emplace_back(field);
 		if(*input == ';') {
 			input++;
 			break;
 		}
 	}
-	return fields;
+	dest.first_field = (u32) arena.fields.size();
+	dest.field_count = (u32) (arena.field_stack.size() - stack_base);
+	arena.fields.insert(arena.fields.end(), arena.field_stack.begin() + stack_base, arena.field_stack.end());
+	arena.field_stack.resize(stack_base);
 }
 
 static s8 eat_s8(const char*& input) {
@@ -170,41 +260,50 @@ static s8 eat_s8(const char*& input) {
 	return *(input++);
 }
 
-static s64 eat_s64_literal(const char*& input) {
-	std::string number;
+s64 eat_s64_literal(const char*& input) {
+	bool negative = false;
 	if(*input == '-') {
-		number = "-";
+		negative = true;
 		input++;
 	}
-	for(; *input != '\0'; input++) {
-		if(*input < '0' || *input > '9') {
-			break;
+	const char* digits = input;
+	// Values that don't fit are returned as zero. The magnitude limit for a
+	// negative number is one greater than for a positive number.
+	u64 limit = negative ? (u64) INT64_MAX + 1 : (u64) INT64_MAX;
+	u64 value = 0;
+	bool overflow = false;
+	for(; *input >= '0' && *input <= '9'; input++) {
+		u64 digit = *input - '0';
+		if(value > (limit - digit) / 10) {
+			overflow = true;
+		} else {
+			value = value * 10 + digit;
 		}
-		number += *input;
 	}
-	verify(number.size() > 0, "error: Unexpected '%c' (%02hhx).\n", *input, *input);
-	try {
-		return std::stol(number);
-	} catch(std::out_of_range&) {
+	verify(input != digits, "error: Unexpected '%c' (%02hhx).\n", *input, *input);
+	if(overflow) {
 		return 0;
 	}
+	return negative ? (s64) (0 - value) : (s64) value;
 }
 
-static std::string eat_identifier(const char*& input) {
-	std::string identifier;
-	bool first = true;
-	for(; *input != '\0'; input++) {
-		bool valid_char = false;
-		valid_char |= isprint(*input) && *input != ':' && *input != ';';
-		valid_char |= !first && isalnum(*input);
-		if(valid_char) {
-			identifier += *input;
-		} else {
-			return identifier;
+// Identifiers can contain any printable character other than ':' and ';'.
+static const struct IdentifierCharTable {
+	bool valid[256];
+	constexpr IdentifierCharTable() : valid() {
+		for(int c = ' '; c <= '~'; c++) {
+			valid[c] = c != ':' && c != ';';
 		}
-		first = false;
 	}
-	verify_not_reached(ERR_END_OF_INPUT);
+} IDENTIFIER_CHARS;
+
+std::string_view eat_identifier(const char*& input) {
+	const char* begin = input;
+	while(IDENTIFIER_CHARS.valid[(u8) *input]) {
+		input++;
+	}
+	verify(*input != '\0', ERR_END_OF_INPUT);
+	return std::string_view(begin, input - begin);
 }
 
 static void expect_s8(const char*& input, s8 expected, const char* subject) {
@@ -233,14 +332,148 @@ static void validate_symbol_descriptor(StabsSymbolDescriptor descriptor) {
 	}
 }
 
-void print_stabs_type(const StabsType& type) {
+void StabsTypeNumberIndex::add(s64 type_number, StabsTypeIndex type) {
+	if(type_number >= 0 && type_number < 0x100000) {
+		if((u64) type_number >= dense.size()) {
+			dense.resize(type_number + 1, NO_STABS_TYPE);
+		}
+		dense[type_number] = type;
+	} else if(type_number < 0) {
+		auto iter = std::lower_bound(shared.begin(), shared.end(), type_number,
+			[](const std::pair<s64, StabsTypeIndex>& lhs, s64 rhs) { return lhs.first < rhs; });
+		if(iter != shared.end() && iter->first == type_number) {
+			iter->second = type;
+		} else {
+			shared.emplace(iter, type_number, type);
+		}
+	} else {
+		sparse[type_number] = type;
+	}
+}
+
+StabsTypeIndex StabsTypeNumberIndex::lookup(s64 type_number) const {
+	if(type_number >= 0 && (u64) type_number < dense.size()) {
+		return dense[type_number];
+	}
+	if(type_number < 0) {
+		auto iter = std::lower_bound(shared.begin(), shared.end(), type_number,
+			[](const std::pair<s64, StabsTypeIndex>& lhs, s64 rhs) { return lhs.first < rhs; });
+		return iter != shared.end() && iter->first == type_number ? iter->second : NO_STABS_TYPE;
+	}
+	auto iter = sparse.find(type_number);
+	return iter != sparse.end() ? iter->second : NO_STABS_TYPE;
+}
+
+StabsTypeNumberIndex build_type_number_index(const StabsTypeArena& arena, const std::vector<StabsSymbol>& symbols) {
+	StabsTypeNumberIndex index;
+	for(StabsTypeIndex i = 0; i < arena.types.size(); i++) {
+		const StabsType& type = arena.types[i];
+		if(type.descriptor == StabsTypeDescriptor::TYPE_REFERENCE && type.aux_type != NO_STABS_TYPE) {
+			index.add(type.type_reference.type_number, type.aux_type);
+		}
+	}
+	for(const StabsSymbol& symbol : symbols) {
+		if(symbol.type != NO_STABS_TYPE) {
+			index.add(symbol.type_number, symbol.type);
+		}
+	}
+	return index;
+}
+
+StabsTypeIndex resolve_stabs_type(const StabsTypeArena& arena, const StabsTypeNumberIndex& index, StabsTypeIndex type) {
+	// Some types are defined in terms of themselves e.g. "void:t19=19", so
+	// give up if we end up going around in circles.
+	for(u32 hops = 0; type != NO_STABS_TYPE && hops < 64; hops++) {
+		const StabsType& node = arena.type(type);
+		if(node.descriptor != StabsTypeDescriptor::TYPE_REFERENCE) {
+			return type;
+		}
+		StabsTypeIndex next = node.aux_type != NO_STABS_TYPE
+			? node.aux_type
+			: index.lookup(node.type_reference.type_number);
+		if(next == type) {
+			return type;
+		}
+		type = next;
+	}
+	return type;
+}
+
+StabsTypeIndex stabs_inner_type(const StabsTypeArena& arena, const StabsTypeNumberIndex& index, StabsTypeIndex type) {
+	type = resolve_stabs_type(arena, index, type);
+	if(type == NO_STABS_TYPE) {
+		return NO_STABS_TYPE;
+	}
+	const StabsType& node = arena.type(type);
+	switch(node.descriptor) {
+		case StabsTypeDescriptor::POINTER:
+			return resolve_stabs_type(arena, index, node.pointer_type.value_type);
+		case StabsTypeDescriptor::ARRAY:
+			return resolve_stabs_type(arena, index, node.array_type.element_type);
+		case StabsTypeDescriptor::RANGE:
+			return resolve_stabs_type(arena, index, node.range_type.type);
+		default:
+			return NO_STABS_TYPE;
+	}
+}
+
+void print_stabs_type(const StabsTypeArena& arena, StabsTypeIndex type_index) {
+	const StabsType& type = arena.type(type_index);
 	printf("type descriptor: %c\n", (s8) type.descriptor);
 	printf("fields (offset, size, offset in bits, size in bits, name):\n");
-	for(const StabsField& field : type.struct_type.fields) {
-		print_field(field);
+	if(type.descriptor == StabsTypeDescriptor::STRUCT || type.descriptor == StabsTypeDescriptor::UNION) {
+		for(u32 i = 0; i < type.struct_type.field_count; i++) {
+			print_field(arena.view(), arena.fields[type.struct_type.first_field + i]);
+		}
+	}
+}
+
+void print_stabs_symbol_fields(const StabsTypeArena& arena, const StabsSymbol& symbol) {
+	StabsTypeArenaView view = arena.view();
+	for_each_stabs_symbol_field(view, symbol, [&](const StabsField& field) {
+		print_field(view, field);
+	});
+}
+
+void for_each_stabs_symbol_field(const StabsTypeArenaView& arena, const StabsSymbol& symbol, const std::function<void(const StabsField& field)>& func) {
+	if(symbol.type != NO_STABS_TYPE) {
+		visit_nested_fields(arena, symbol.type, func);
+	}
+}
+
+static void visit_nested_fields(const StabsTypeArenaView& arena, StabsTypeIndex type_index, const std::function<void(const StabsField& field)>& func) {
+	// This has to visit the types in the same order that parse_type does.
+	const StabsType& type = arena.type(type_index);
+	switch(type.descriptor) {
+		case StabsTypeDescriptor::ARRAY:
+			visit_nested_fields(arena, type.array_type.index_type, func);
+			visit_nested_fields(arena, type.array_type.element_type, func);
+			break;
+		case StabsTypeDescriptor::RANGE:
+			visit_nested_fields(arena, type.range_type.type, func);
+			break;
+		case StabsTypeDescriptor::STRUCT:
+		case StabsTypeDescriptor::UNION:
+			if(type.struct_type.base_class != NO_STABS_TYPE) {
+				visit_nested_fields(arena, type.struct_type.base_class, func);
+			}
+			for(u32 i = 0; i < type.struct_type.field_count; i++) {
+				const StabsField& field = arena.fields[type.struct_type.first_field + i];
+				visit_nested_fields(arena, field.type, func);
+				func(field);
+			}
+			break;
+		case StabsTypeDescriptor::POINTER:
+			visit_nested_fields(arena, type.pointer_type.value_type, func);
+			break;
+		default: {}
+	}
+	if(type.aux_type != NO_STABS_TYPE) {
+		visit_nested_fields(arena, type.aux_type, func);
 	}
 }
 
-static void print_field(const StabsField& field) {
-	printf("%04lx %04lx %04lx %04lx %s\n", field.offset / 8, field.size / 8, field.offset, field.size, field.name.c_str());
+static void print_field(const StabsTypeArenaView& arena, const StabsField& field) {
+	std::string_view name = arena.string(field.name);
+	printf("%04lx %04lx %04lx %04lx %.*s\n", field.offset / 8, field.size / 8, field.offset, field.size, (int) name.size(), name.data());
 }
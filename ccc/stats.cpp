@@ -0,0 +1,139 @@
+#include "ccc.h"
+
+#include <atomic>
+
+static std::atomic<StatsCollector*> stats_collector = nullptr;
+static thread_local u32 stats_depth = 0;
+
+static u64 microseconds_since(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+static u64 thread_cpu_time_us();
+static u32 current_thread_number(StatsCollector& collector);
+
+void set_stats_collector(StatsCollector* collector) {
+	stats_collector = collector;
+}
+
+StatsCollector* get_stats_collector() {
+	return stats_collector;
+}
+
+void add_stats_counter(const char* name, u64 value) {
+	StatsCollector* collector = stats_collector;
+	if(!collector) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(collector->mutex);
+	for(StatsCounter& counter : collector->counters) {
+		if(strcmp(counter.name, name) == 0) {
+			counter.value += value;
+			return;
+		}
+	}
+	collector->counters.push_back({name, value});
+}
+
+StatsScope::StatsScope(const char* n) : collector(stats_collector), name(n) {
+	if(collector) {
+		depth = stats_depth++;
+		wall_start = std::chrono::steady_clock::now();
+		cpu_start_us = thread_cpu_time_us();
+	}
+}
+
+StatsScope::~StatsScope() {
+	if(!collector) {
+		return;
+	}
+	std::chrono::steady_clock::time_point wall_end = std::chrono::steady_clock::now();
+	u64 cpu_end_us = thread_cpu_time_us();
+	stats_depth--;
+	StatsPhase phase;
+	phase.name = name;
+	phase.depth = depth;
+	phase.start_us = microseconds_since(collector->start, wall_start);
+	phase.wall_us = microseconds_since(wall_start, wall_end);
+	phase.cpu_us = cpu_end_us - cpu_start_us;
+	std::lock_guard<std::mutex> lock(collector->mutex);
+	phase.thread = current_thread_number(*collector);
+	collector->phases.push_back(phase);
+}
+
+void print_stats(const StatsCollector& collector, FILE* file) {
+	// Phases are recorded when they end, so sort them so that parents come
+	// before their children.
+	std::vector<StatsPhase> phases = collector.phases;
+	std::stable_sort(phases.begin(), phases.end(), [](const StatsPhase& lhs, const StatsPhase& rhs) {
+		return lhs.start_us < rhs.start_us || (lhs.start_us == rhs.start_us && lhs.depth < rhs.depth);
+	});
+	fprintf(file, "%-40s %12s %16s\n", "PHASE", "WALL (ms)", "THREAD CPU (ms)");
+	for(const StatsPhase& phase : phases) {
+		fprintf(file, "%*s%-*s %12.3f %16.3f\n", phase.depth * 2, "", 40 - phase.depth * 2, phase.name,
+			phase.wall_us / 1000.0, phase.cpu_us / 1000.0);
+	}
+	fprintf(file, "\n%-40s %12s\n", "COUNTER", "VALUE");
+	for(const StatsCounter& counter : collector.counters) {
+		fprintf(file, "%-40s %12lu\n", counter.name, counter.value);
+	}
+}
+
+void write_chrome_trace(const StatsCollector& collector, FILE* file) {
+	OutputBuffer out(file);
+	write_string(out, "{\"traceEvents\":[");
+	bool first = true;
+	u64 end_us = 0;
+	for(const StatsPhase& phase : collector.phases) {
+		write_string(out, first ? "\n{\"name\":" : ",\n{\"name\":");
+		write_json_string(out, phase.name);
+		write_string(out, ",\"ph\":\"X\",\"pid\":1,\"tid\":");
+		write_decimal(out, phase.thread);
+		write_string(out, ",\"ts\":");
+		write_decimal(out, phase.start_us);
+		write_string(out, ",\"dur\":");
+		write_decimal(out, phase.wall_us);
+		write_string(out, ",\"args\":{\"cpu_us\":");
+		write_decimal(out, phase.cpu_us);
+		write_string(out, "}}");
+		end_us = std::max(end_us, phase.start_us + phase.wall_us);
+		first = false;
+	}
+	// The counters only have final values, so emit them at the end.
+	for(const StatsCounter& counter : collector.counters) {
+		write_string(out, first ? "\n{\"name\":" : ",\n{\"name\":");
+		write_json_string(out, counter.name);
+		write_string(out, ",\"ph\":\"C\",\"pid\":1,\"ts\":");
+		write_decimal(out, end_us);
+		write_string(out, ",\"args\":{\"value\":");
+		write_decimal(out, counter.value);
+		write_string(out, "}}");
+		first = false;
+	}
+	write_string(out, "\n]}\n");
+}
+
+static u64 microseconds_since(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+}
+
+static u64 thread_cpu_time_us() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return (u64) time.tv_sec * 1000000 + time.tv_nsec / 1000;
+#else
+	// Falls back to process CPU time where there's no per-thread clock.
+	return (u64) std::clock() * 1000000 / CLOCKS_PER_SEC;
+#endif
+}
+
+static u32 current_thread_number(StatsCollector& collector) {
+	// Number the threads in the order they first record something, so the
+	// trace viewer shows the main thread first.
+	std::thread::id id = std::this_thread::get_id();
+	for(size_t i = 0; i < collector.threads.size(); i++) {
+		if(collector.threads[i] == id) {
+			return i + 1;
+		}
+	}
+	collector.threads.push_back(id);
+	return collector.threads.size();
+}
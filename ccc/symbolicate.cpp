@@ -0,0 +1,120 @@
+#include "ccc.h"
+
+static void radix_sort(std::vector<u32>& values);
+
+std::vector<u32> read_address_stream(FILE* file) {
+	std::vector<u32> addresses;
+	std::vector<char> buffer(1024 * 1024);
+	// The start of the current token is kept around for the error message.
+	char token[32];
+	u32 token_size = 0;
+	u32 value = 0;
+	u32 digit_count = 0;
+	bool valid = true;
+	auto end_token = [&]() {
+		if(token_size == 0) {
+			return;
+		}
+		token[std::min(token_size, (u32) sizeof(token) - 1)] = '\0';
+		verify(valid && digit_count > 0, "error: Invalid address '%s'.\n", token);
+		addresses.push_back(value);
+		token_size = 0;
+		value = 0;
+		digit_count = 0;
+		valid = true;
+	};
+	for(;;) {
+		size_t size = fread(buffer.data(), 1, buffer.size(), file);
+		if(size == 0) {
+			break;
+		}
+		for(size_t i = 0; i < size; i++) {
+			char c = buffer[i];
+			if(c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+				end_token();
+				continue;
+			}
+			if(token_size < sizeof(token) - 1) {
+				token[token_size] = c;
+			}
+			token_size++;
+			u32 digit;
+			if(c >= '0' && c <= '9') {
+				digit = c - '0';
+			} else if(c >= 'a' && c <= 'f') {
+				digit = c - 'a' + 10;
+			} else if(c >= 'A' && c <= 'F') {
+				digit = c - 'A' + 10;
+			} else if((c == 'x' || c == 'X') && token_size == 2 && token[0] == '0') {
+				// Skip the 0x prefix.
+				value = 0;
+				digit_count = 0;
+				continue;
+			} else {
+				valid = false;
+				continue;
+			}
+			// Anything longer than 8 digits doesn't fit.
+			valid &= digit_count < 8;
+			value = (value << 4) | digit;
+			digit_count++;
+		}
+	}
+	end_token();
+	return addresses;
+}
+
+std::vector<ProcedureSampleCount> symbolicate_addresses(const SymbolTable& symbol_table, const ProcedureAddressIndex& index, std::vector<u32>& addresses) {
+	StatsScope scope("symbolicate addresses");
+	radix_sort(addresses);
+	
+	std::vector<ProcedureSampleCount> counts;
+	const std::vector<u32>& procedures = index.sorted_procedures;
+	s64 current = -1; // Position in procedures.
+	size_t i = 0;
+	while(i < addresses.size()) {
+		// Advance to the last procedure that starts at or before this address.
+		while(current + 1 < (s64) procedures.size()
+			&& symbol_table.procedures[procedures[current + 1]].address <= addresses[i]) {
+			current++;
+		}
+		// Count all the samples up to the start of the next procedure.
+		u64 end = current + 1 < (s64) procedures.size()
+			? symbol_table.procedures[procedures[current + 1]].address
+			: (u64) UINT32_MAX + 1;
+		size_t first = i;
+		while(i < addresses.size() && addresses[i] < end) {
+			i++;
+		}
+		counts.push_back({current >= 0 ? (s64) procedures[current] : -1, i - first});
+	}
+	
+	std::stable_sort(counts.begin(), counts.end(), [](const ProcedureSampleCount& lhs, const ProcedureSampleCount& rhs) {
+		return lhs.count > rhs.count;
+	});
+	return counts;
+}
+
+static void radix_sort(std::vector<u32>& values) {
+	// Least significant digit first, 11 bits at a time, so three passes.
+	const u32 BITS = 11;
+	const u32 BUCKETS = 1 << BITS;
+	std::vector<u32> temp(values.size());
+	std::vector<u64> offsets(BUCKETS);
+	for(u32 shift = 0; shift < 32; shift += BITS) {
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for(u32 value : values) {
+			offsets[(value >> shift) & (BUCKETS - 1)]++;
+		}
+		u64 total = 0;
+		for(u64& offset : offsets) {
+			u64 count = offset;
+			offset = total;
+			total += count;
+		}
+		for(u32 value : values) {
+			temp[offsets[(value >> shift) & (BUCKETS - 1)]++] = value;
+		}
+		values.swap(temp);
+	}
+}
@@ -1,16 +1,131 @@
 #include "ccc.h"
 
-std::string read_string(const std::vector<u8>& bytes, u64 offset) {
-	if(offset > bytes.size()) {
+#include <atomic>
+#include <thread>
+
+static thread_local bool verify_recoverable = false;
+
+VerifyRecoveryScope::VerifyRecoveryScope() : previous(verify_recoverable) {
+	verify_recoverable = true;
+}
+
+VerifyRecoveryScope::~VerifyRecoveryScope() {
+	verify_recoverable = previous;
+}
+
+bool is_verify_recoverable() {
+	return verify_recoverable;
+}
+
+void report_verify_failure(const char* file, int line, const char* message) {
+	if(verify_recoverable) {
+		std::string_view str = message;
+		if(!str.empty() && str.back() == '\n') {
+			str.remove_suffix(1);
+		}
+		throw VerifyFailure{std::string(str)};
+	}
+	fprintf(stderr, "[%s:%d] %s", file, line, message);
+	exit(1);
+}
+
+std::string_view read_string_view(ByteSpan bytes, u64 offset) {
+	if(offset < bytes.base || offset > bytes.end_offset()) {
 		return "(unexpected eof)";
 	}
-	std::string result;
-	for(u64 i = offset; i < bytes.size(); i++) {
-		if(bytes[i] == 0) {
-			break;
+	const char* begin = (const char*) &bytes[offset];
+	u64 max_size = bytes.end_offset() - offset;
+	// memchr is vectorised by the C library, unlike a byte by byte loop.
+	const char* terminator = (const char*) memchr(begin, 0, max_size);
+	return std::string_view(begin, terminator ? terminator - begin : max_size);
+}
+
+std::string read_string(ByteSpan bytes, u64 offset) {
+	return std::string(read_string_view(bytes, offset));
+}
+
+bool match_glob(std::string_view pattern, std::string_view str) {
+	// When a character doesn't match, let the last star eat one more
+	// character and try again from there.
+	u64 p = 0;
+	u64 s = 0;
+	u64 star = std::string_view::npos;
+	u64 star_match = 0;
+	while(s < str.size()) {
+		if(p < pattern.size() && (pattern[p] == '?' || pattern[p] == str[s])) {
+			p++;
+			s++;
+		} else if(p < pattern.size() && pattern[p] == '*') {
+			star = p++;
+			star_match = s;
+		} else if(star != std::string_view::npos) {
+			p = star + 1;
+			s = ++star_match;
 		} else {
-			result += bytes[i];
+			return false;
+		}
+	}
+	while(p < pattern.size() && pattern[p] == '*') {
+		p++;
+	}
+	return p == pattern.size();
+}
+
+u64 hash_bytes(const void* data, u64 size, u64 seed) {
+	const u8* bytes = (const u8*) data;
+	u64 hash = seed ^ (size * 0xc6a4a7935bd1e995);
+	u64 i = 0;
+	for(; i + 8 <= size; i += 8) {
+		u64 word;
+		memcpy(&word, bytes + i, 8);
+		hash = ((hash << 5 | hash >> 59) ^ word) * 0x9e3779b97f4a7c15;
+	}
+	u64 last = 0;
+	memcpy(&last, bytes + i, size - i);
+	hash = ((hash << 5 | hash >> 59) ^ last) * 0x9e3779b97f4a7c15;
+	hash ^= hash >> 32;
+	hash *= 0xd6e8feb86659fd93;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+void parallel_for(u64 count, u32 thread_count, const std::function<void(u64)>& func) {
+	thread_count = (u32) std::min<u64>(std::max<u32>(thread_count, 1), count);
+	if(thread_count <= 1) {
+		for(u64 i = 0; i < count; i++) {
+			func(i);
 		}
+		return;
+	}
+	std::atomic<u64> next = 0;
+	std::mutex error_mutex;
+	std::exception_ptr error;
+	auto worker = [&]() {
+		try {
+			for(u64 i = next++; i < count; i = next++) {
+				func(i);
+			}
+		} catch(...) {
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if(!error) {
+				error = std::current_exception();
+			}
+			next = count;
+		}
+	};
+	bool recoverable = verify_recoverable;
+	std::vector<std::thread> threads;
+	for(u32 i = 1; i < thread_count; i++) {
+		threads.emplace_back([&]() {
+			verify_recoverable = recoverable;
+			worker();
+		});
+	}
+	worker();
+	for(std::thread& thread : threads) {
+		thread.join();
+	}
+	if(error) {
+		std::rethrow_exception(error);
 	}
-	return result;
 }
@@ -1,5 +1,7 @@
 #include "ccc/ccc.h"
 
+#include <thread>
+
 void print_address(const char* name, u64 address) {
 	fprintf(stderr, "%32s @ 0x%08lx\n", name, address);
 }
@@ -7,18 +9,82 @@ void print_address(const char* name, u64 address) {
 enum OutputMode : u32 {
 	OUTPUT_HELP = 0,
 	OUTPUT_SYMBOLS = 1,
-	OUTPUT_TYPES = 2
+	OUTPUT_TYPES = 2,
+	OUTPUT_SYMBOLICATE = 4,
+	OUTPUT_SERVER = 8,
+	OUTPUT_DIFF = 16
+};
+
+static OutputMode& operator|=(OutputMode& lhs, OutputMode rhs) {
+	return lhs = (OutputMode) (lhs | rhs);
+}
+
+// Asking for more threads than this is almost certainly a mistake, and each
+// one reserves a stack.
+static const u32 MAX_THREAD_COUNT = 256;
+
+enum OutputFormat {
+	FORMAT_TEXT,
+	FORMAT_JSON
 };
 
 struct Options {
 	OutputMode mode = OUTPUT_HELP;
-	fs::path input_file;
+	OutputFormat format = FORMAT_TEXT;
+	std::vector<fs::path> input_files;
+	u64 memory_limit = 1024 * 1024 * 1024;
 	bool verbose = false;
+	bool partial = false;
+	u32 thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+	fs::path cache_file;
+	std::string samples_file;
+	bool stats = false;
+	fs::path trace_file;
+	fs::path socket_file;
+	fs::path old_file;
+	SymbolFilter filter;
+};
+
+// The STABS symbols for a whole symbol table, with the types shared between
+// all the files.
+struct StabsSymbols {
+	StabsTypeArena arena;
+	std::vector<StabsInternedFile> files;
+};
+
+// All the modes write to the same buffer. In JSON mode the output of each one
+// is a separate member of a single top level object.
+struct Output {
+	OutputBuffer buffer{stdout};
+	OutputFormat format;
+	bool first_section = true;
 };
 
 Options parse_args(int argc, char** argv);
-void print_symbols(Program& program, SymbolTable& symbol_table);
-void print_types(Program& program, SymbolTable& symbol_table);
+void process_input(Output& out, const fs::path& input_file, const Options& options);
+void process_inputs_in_batch(Output& out, const Options& options);
+void run_server(const Options& options);
+void print_diff(Output& out, const Options& options);
+const ProgramSection& load_mdebug_section(Program& program, const fs::path& path);
+void write_symbol_diffs(Output& out, const char* name, const std::vector<SymbolDiff>& diffs);
+void write_struct_diffs(Output& out, const std::vector<StructDiff>& diffs);
+bool load_symbol_table(SymbolTable& symbol_table, StabsSymbols& stabs, SymbolTableCache& cache, const ProgramImage& image, const ProgramSection& section, const Options& options);
+void parse_stabs(StabsSymbols& stabs, const SymbolTable& symbol_table, const Options& options);
+u64 parse_symbol_kinds(const std::string& list, u32 count, const char* (*name)(u32 i));
+SymbolFilter stabs_filter(const Options& options);
+bool is_filtered(const SymbolFilter& filter);
+void print_symbols(Output& out, const ProgramImage& image, const ProgramSection& section, const SymbolFilter& filter);
+void print_symbols(Output& out, const SymbolTable& symbol_table, const SymbolFilter& filter);
+void print_symbols(Output& out, const SymbolTableCache& cache, const SymbolFilter& filter);
+template <typename GetSymbol>
+bool print_file_symbols(Output& out, std::string_view name, u64 symbol_count, GetSymbol get_symbol, bool first_file, const SymbolFilter& filter);
+void print_types(Output& out, const StabsSymbols& stabs);
+void print_types(Output& out, const SymbolTableCache& cache);
+void print_stabs_symbol(Output& out, const StabsTypeArenaView& arena, std::string_view text, const StabsSymbol& symbol, bool first_symbol);
+void print_symbolicated(Output& out, const SymbolTable& symbol_table, const Options& options);
+void begin_json_section(Output& out, const char* name);
+void write_symbol_type(Output& out, SymbolType type);
+void write_symbol_class(Output& out, SymbolClass symbol_class);
 void print_help();
 
 int main(int argc, char** argv) {
@@ -28,34 +94,241 @@ int main(int argc, char** argv) {
 		exit(1);
 	}
 	
+	StatsCollector stats;
+	if(options.stats || !options.trace_file.empty()) {
+		set_stats_collector(&stats);
+	}
+	
+	Output out;
+	out.format = options.format;
+	if(options.mode & OUTPUT_SERVER) {
+		run_server(options);
+	} else if(options.mode & OUTPUT_DIFF) {
+		print_diff(out, options);
+	} else if(options.input_files.size() > 1 || fs::is_directory(options.input_files[0])) {
+		process_inputs_in_batch(out, options);
+	} else {
+		process_input(out, options.input_files[0], options);
+	}
+	
+	set_stats_collector(nullptr);
+	if(options.stats) {
+		print_stats(stats, stderr);
+	}
+	if(!options.trace_file.empty()) {
+		FILE* trace = fopen(options.trace_file.c_str(), "wb");
+		verify(trace, "error: Failed to open trace file.\n");
+		write_chrome_trace(stats, trace);
+		fclose(trace);
+	}
+}
+
+void process_input(Output& out, const fs::path& input_file, const Options& options) {
 	Program program;
-	program.images.emplace_back(read_program_image(options.input_file));
-	parse_elf_file(program, 0);
+	if(options.partial) {
+		read_elf_headers(program, input_file);
+	} else {
+		program.images.emplace_back(map_program_image(input_file));
+		parse_elf_file(program, 0);
+	}
 	
-	SymbolTable symbol_table;
-	bool has_symbol_table = false;
+	ProgramSection* mdebug_section = nullptr;
 	for(ProgramSection& section : program.sections) {
 		if(section.type == ProgramSectionType::MIPS_DEBUG) {
-			if(options.verbose) {
-				print_address("mdebug section", section.file_offset);
-			}
-			symbol_table = parse_symbol_table(program.images[0], section);
-			has_symbol_table = true;
+			mdebug_section = &section;
 		}
 	}
-	verify(has_symbol_table, "No symbol table.\n");
+	verify(mdebug_section, "No symbol table.\n");
+	ProgramSection& section = *mdebug_section;
+	if(options.verbose) {
+		print_address("mdebug section", section.file_offset);
+	}
+	if(options.partial) {
+		read_program_section(program, section);
+	}
+	const ProgramImage& image = program.images[section.image];
+	prefetch_program_section(image, section);
+	
+	// Without a cache the symbol listing is streamed straight from the image,
+	// so the whole symbol table only needs to be built for the other modes.
+	SymbolTable symbol_table;
+	StabsSymbols stabs;
+	SymbolTableCache cache;
+	bool cache_hit = false;
+	if((options.mode & ~OUTPUT_SYMBOLS) || options.verbose || !options.cache_file.empty()) {
+		cache_hit = load_symbol_table(symbol_table, stabs, cache, image, section, options);
+	}
 	if(options.verbose) {
 		print_address("procedure descriptor table", symbol_table.procedure_descriptor_table_offset);
 		print_address("local symbol table", symbol_table.local_symbol_table_offset);
 		print_address("file descriptor table", symbol_table.file_descriptor_table_offset);
+		u64 external_count = cache_hit ? cache.header->external_names.count : symbol_table.externals.size();
+		fprintf(stderr, "%32s : %lu\n", "external symbols", external_count);
 	}
 	
+	StatsScope scope("write output");
 	if(options.mode & OUTPUT_SYMBOLS) {
-		print_symbols(program, symbol_table);
+		if(cache_hit) {
+			print_symbols(out, cache, options.filter);
+		} else if(!options.cache_file.empty()) {
+			print_symbols(out, symbol_table, options.filter);
+		} else {
+			print_symbols(out, image, section, options.filter);
+		}
+	}
+	if(options.mode & OUTPUT_TYPES) {
+		if(cache_hit) {
+			print_types(out, cache);
+		} else {
+			print_types(out, stabs);
+		}
 	}
+	if(options.mode & OUTPUT_SYMBOLICATE) {
+		print_symbolicated(out, symbol_table, options);
+	}
+	if(out.format == FORMAT_JSON) {
+		write_string(out.buffer, "}\n");
+	}
+	flush_output(out.buffer);
+}
+
+void process_inputs_in_batch(Output& out, const Options& options) {
+	verify(!(options.mode & OUTPUT_SYMBOLICATE), "error: Can't symbolicate addresses for multiple inputs.\n");
+	verify(options.cache_file.empty(), "error: Can't use a cache file with multiple inputs.\n");
+	std::vector<fs::path> inputs = collect_batch_inputs(options.input_files);
+	// Each input is parsed on a single thread, and the inputs are spread
+	// between the threads instead.
+	Options image_options = options;
+	image_options.thread_count = 1;
+	image_options.verbose = false;
+	BatchOptions batch_options;
+	batch_options.thread_count = options.thread_count;
+	batch_options.memory_limit = options.memory_limit;
+	batch_options.filter = options.filter;
 	if(options.mode & OUTPUT_TYPES) {
-		print_types(program, symbol_table);
+		// The symbols are filtered again when they're printed.
+		SymbolFilter filter = stabs_filter(options);
+		if(options.mode & OUTPUT_SYMBOLS) {
+			filter.types |= options.filter.types;
+			filter.classes |= options.filter.classes;
+		}
+		batch_options.filter = filter;
+	}
+	std::mutex output_mutex;
+	bool first_image = true;
+	if(out.format == FORMAT_JSON) {
+		write_char(out.buffer, '[');
+	}
+	u64 failed_count = 0;
+	process_batch(inputs, batch_options, [&](u64, BatchImage& image) {
+		StabsSymbols stabs;
+		if(image.mdebug_section && (options.mode & OUTPUT_TYPES)) {
+			try {
+				VerifyRecoveryScope recovery;
+				parse_stabs(stabs, image.symbol_table, image_options);
+			} catch(VerifyFailure& failure) {
+				image.error = std::move(failure.message);
+			}
+		}
+		bool failed = !image.error.empty();
+		// The inputs finish in whatever order they finish in, so the path
+		// is written out with each one.
+		std::lock_guard<std::mutex> lock(output_mutex);
+		std::string path = image.path.string();
+		if(out.format == FORMAT_JSON) {
+			write_string(out.buffer, first_image ? "{\"path\":" : ",\n{\"path\":");
+			write_json_string(out.buffer, path);
+			if(failed) {
+				write_string(out.buffer, ",\"error\":");
+				write_json_string(out.buffer, image.error);
+			}
+			out.first_section = false;
+		} else {
+			write_string(out.buffer, "IMAGE ");
+			write_string(out.buffer, path);
+			if(failed) {
+				write_string(out.buffer, ": ");
+				write_string(out.buffer, image.error);
+				write_char(out.buffer, '\n');
+			} else {
+				write_string(out.buffer, image.mdebug_section ? ":\n" : ": no symbol table\n");
+			}
+		}
+		first_image = false;
+		failed_count += failed;
+		if(image.mdebug_section && !failed) {
+			if(options.mode & OUTPUT_SYMBOLS) {
+				print_symbols(out, image.symbol_table, options.filter);
+			}
+			if(options.mode & OUTPUT_TYPES) {
+				print_types(out, stabs);
+			}
+		}
+		if(out.format == FORMAT_JSON) {
+			write_char(out.buffer, '}');
+		}
+	});
+	if(out.format == FORMAT_JSON) {
+		write_string(out.buffer, "]\n");
+	}
+	flush_output(out.buffer);
+	// The failures have already been reported in the output.
+	verify(failed_count == 0, "error: Failed to process %lu of %lu inputs.\n", failed_count, inputs.size());
+}
+
+void run_server(const Options& options) {
+	verify(options.mode == OUTPUT_SERVER, "error: The server can't be combined with other modes.\n");
+	SymbolServer server;
+	init_symbol_server(server, options.input_files, options.thread_count);
+	// Poll for modified inputs rather than using a platform specific file
+	// change notification API. Queries never wait on a reload.
+	std::thread([&server]() {
+		for(;;) {
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			reload_modified_databases(server);
+		}
+	}).detach();
+	if(options.socket_file.empty()) {
+		serve_queries(server, stdin, stdout);
+	} else {
+		serve_queries_on_socket(server, options.socket_file);
+	}
+}
+
+void print_diff(Output& out, const Options& options) {
+	verify(options.mode == OUTPUT_DIFF, "error: The diff can't be combined with other modes.\n");
+	verify(options.input_files.size() == 1, "error: Only one input can be compared against the old file.\n");
+	Program old_program;
+	const ProgramSection& old_section = load_mdebug_section(old_program, options.old_file);
+	IncrementalSymbolTable old_table = parse_symbol_table_incrementally(old_program.images[0], old_section, nullptr, options.thread_count);
+	// The files that are the same in both versions only need to be parsed
+	// once.
+	Program new_program;
+	const ProgramSection& new_section = load_mdebug_section(new_program, options.input_files[0]);
+	IncrementalSymbolTable new_table = parse_symbol_table_incrementally(new_program.images[0], new_section, &old_table, options.thread_count);
+	SymbolTableDiff diff = diff_symbol_tables(old_table, new_table);
+	
+	StatsScope scope("write output");
+	write_symbol_diffs(out, "functions", diff.functions);
+	write_symbol_diffs(out, "globals", diff.globals);
+	write_struct_diffs(out, diff.structs);
+	if(out.format == FORMAT_JSON) {
+		write_string(out.buffer, "}\n");
+	}
+	flush_output(out.buffer);
+}
+
+const ProgramSection& load_mdebug_section(Program& program, const fs::path& path) {
+	program.images.emplace_back(map_program_image(path));
+	parse_elf_file(program, 0);
+	const ProgramSection* mdebug_section = nullptr;
+	for(const ProgramSection& section : program.sections) {
+		if(section.type == ProgramSectionType::MIPS_DEBUG) {
+			mdebug_section = &section;
+		}
 	}
+	verify(mdebug_section, "error: No symbol table in '%s'.\n", path.string().c_str());
+	return *mdebug_section;
 }
 
 Options parse_args(int argc, char** argv) {
@@ -63,14 +336,92 @@ Options parse_args(int argc, char** argv) {
 	for(int i = 1; i < argc; i++) {
 		std::string arg = argv[i];
 		if(arg == "--symbols" || arg == "-s") {
-			(u32&) options.mode |= OUTPUT_SYMBOLS;
+			options.mode |= OUTPUT_SYMBOLS;
 		}
 		if(arg == "--types" || arg == "-t") {
-			(u32&) options.mode |= OUTPUT_TYPES;
+			options.mode |= OUTPUT_TYPES;
 		}
 		if(arg == "--verbose" || arg == "-v") {
 			options.verbose = true;
 		}
+		if(arg == "--partial" || arg == "-p") {
+			options.partial = true;
+		}
+		if(arg == "--threads" || arg == "-j") {
+			verify(i + 1 < argc, "error: No thread count specified.\n");
+			const char* count = argv[++i];
+			char* end = nullptr;
+			long thread_count = strtol(count, &end, 10);
+			verify(*count != '\0' && *end == '\0' && thread_count > 0, "error: Invalid thread count '%s'.\n", count);
+			options.thread_count = (u32) std::min(thread_count, (long) MAX_THREAD_COUNT);
+		}
+		if(arg == "--cache" || arg == "-c") {
+			verify(i + 1 < argc, "error: No cache file specified.\n");
+			options.cache_file = argv[++i];
+		}
+		if(arg == "--symbolicate" || arg == "-a") {
+			verify(i + 1 < argc, "error: No address file specified.\n");
+			options.mode |= OUTPUT_SYMBOLICATE;
+			options.samples_file = argv[++i];
+		}
+		if(arg == "--stats") {
+			options.stats = true;
+		}
+		if(arg == "--memory-limit" || arg == "-m") {
+			verify(i + 1 < argc, "error: No memory limit specified.\n");
+			const char* limit = argv[++i];
+			char* end = nullptr;
+			// strtoull would accept leading whitespace and negate a leading '-'.
+			u64 mebibytes = (u64) strtoull(limit, &end, 10);
+			verify(*limit >= '0' && *limit <= '9' && *end == '\0' && mebibytes > 0,
+				"error: Invalid memory limit '%s'.\n", limit);
+			verify(mebibytes <= UINT64_MAX / (1024 * 1024), "error: Memory limit '%s' is too large.\n", limit);
+			options.memory_limit = mebibytes * 1024 * 1024;
+		}
+		if(arg == "--trace") {
+			verify(i + 1 < argc, "error: No trace file specified.\n");
+			options.trace_file = argv[++i];
+		}
+		if(arg == "--server") {
+			options.mode |= OUTPUT_SERVER;
+		}
+		if(arg == "--diff" || arg == "-d") {
+			verify(i + 1 < argc, "error: No old file specified.\n");
+			options.mode |= OUTPUT_DIFF;
+			options.old_file = argv[++i];
+		}
+		if(arg == "--socket") {
+			verify(i + 1 < argc, "error: No socket path specified.\n");
+			options.mode |= OUTPUT_SERVER;
+			options.socket_file = argv[++i];
+		}
+		if(arg == "--file") {
+			verify(i + 1 < argc, "error: No file pattern specified.\n");
+			options.filter.file_pattern = argv[++i];
+		}
+		if(arg == "--type") {
+			verify(i + 1 < argc, "error: No symbol types specified.\n");
+			options.filter.types = (u64) parse_symbol_kinds(argv[++i], 64, [](u32 i) { return symbol_type((SymbolType) i); });
+		}
+		if(arg == "--class") {
+			verify(i + 1 < argc, "error: No symbol classes specified.\n");
+			options.filter.classes = (u32) parse_symbol_kinds(argv[++i], 32, [](u32 i) { return symbol_class((SymbolClass) i); });
+		}
+		if(arg == "--prefix") {
+			verify(i + 1 < argc, "error: No name prefix specified.\n");
+			options.filter.name_prefix = argv[++i];
+		}
+		if(arg == "--format" || arg == "-f") {
+			verify(i + 1 < argc, "error: No output format specified.\n");
+			std::string format = argv[++i];
+			if(format == "text") {
+				options.format = FORMAT_TEXT;
+			} else if(format == "json") {
+				options.format = FORMAT_JSON;
+			} else {
+				verify_not_reached("error: Invalid output format '%s'.\n", format.c_str());
+			}
+		}
 	}
 	for(int i = 1; i < argc; i++) {
 		std::string arg = argv[i];
@@ -83,65 +434,663 @@ Options parse_args(int argc, char** argv) {
 		if(arg == "--verbose" || arg == "-v") {
 			continue;
 		}
-		verify(options.input_file.empty(), "error: Multiple input files specified.\n");
-		options.input_file = arg;
+		if(arg == "--partial" || arg == "-p") {
+			continue;
+		}
+		if(arg == "--threads" || arg == "-j") {
+			i++;
+			continue;
+		}
+		if(arg == "--cache" || arg == "-c") {
+			i++;
+			continue;
+		}
+		if(arg == "--symbolicate" || arg == "-a") {
+			i++;
+			continue;
+		}
+		if(arg == "--format" || arg == "-f") {
+			i++;
+			continue;
+		}
+		if(arg == "--stats") {
+			continue;
+		}
+		if(arg == "--memory-limit" || arg == "-m") {
+			i++;
+			continue;
+		}
+		if(arg == "--trace") {
+			i++;
+			continue;
+		}
+		if(arg == "--server") {
+			continue;
+		}
+		if(arg == "--socket") {
+			i++;
+			continue;
+		}
+		if(arg == "--diff" || arg == "-d") {
+			i++;
+			continue;
+		}
+		if(arg == "--file" || arg == "--type" || arg == "--class" || arg == "--prefix") {
+			i++;
+			continue;
+		}
+		options.input_files.emplace_back(arg);
 	}
+	verify(!options.input_files.empty() || options.mode == OUTPUT_HELP, "error: No input files specified.\n");
+	verify(options.cache_file.empty() || !is_filtered(options.filter), "error: Can't use a cache file with a filter.\n");
 	return options;
 }
 
-void print_symbols(Program& program, SymbolTable& symbol_table) {
-	for(SymFileDescriptor& fd : symbol_table.files) {
-		printf("FILE %s:\n", fd.name.c_str());
-		for(Symbol& sym : fd.symbols) {
-			const char* symbol_type_str = symbol_type(sym.storage_type);
-			const char* symbol_class_str = symbol_class(sym.storage_class);
-			printf("\t%x ", sym.value);
-			if(symbol_type_str) {
-				printf("%s ", symbol_type_str);
-			} else {
-				printf("ST(%d) ", (u32) sym.storage_type);
+// Returns true if the cache was hit. The symbols and types are then printed
+// straight from the mapped cache, and the symbol table is only copied out of it if the
+// addresses are going to be symbolicated.
+bool load_symbol_table(SymbolTable& symbol_table, StabsSymbols& stabs, SymbolTableCache& cache, const ProgramImage& image, const ProgramSection& section, const Options& options) {
+	StatsScope scope("load symbol table");
+	if(options.cache_file.empty()) {
+		// The symbol listing doesn't come from here, so only the symbols that
+		// the other modes need are parsed.
+		SymbolFilter filter;
+		if(options.mode == OUTPUT_TYPES || options.mode == (OUTPUT_TYPES | OUTPUT_SYMBOLS)) {
+			filter = stabs_filter(options);
+		} else {
+			filter.file_pattern = options.filter.file_pattern;
+		}
+		symbol_table = parse_symbol_table(image, section, options.thread_count, filter);
+		if(options.mode & OUTPUT_TYPES) {
+			parse_stabs(stabs, symbol_table, options);
+		}
+		return false;
+	}
+	u64 key = hash_symbol_table_section(image, section);
+	if(map_symbol_table_cache(cache, options.cache_file, key)) {
+		if(options.verbose) {
+			fprintf(stderr, "%32s : %s\n", "cache", "hit");
+		}
+		if(options.mode & OUTPUT_SYMBOLICATE) {
+			symbol_table = load_symbol_table_from_cache(cache);
+		} else {
+			symbol_table.line_number_table_offset = cache.header->line_number_table_offset;
+			symbol_table.procedure_descriptor_table_offset = cache.header->procedure_descriptor_table_offset;
+			symbol_table.local_symbol_table_offset = cache.header->local_symbol_table_offset;
+			symbol_table.file_descriptor_table_offset = cache.header->file_descriptor_table_offset;
+		}
+		return true;
+	}
+	if(options.verbose) {
+		fprintf(stderr, "%32s : %s\n", "cache", "miss");
+	}
+	// The cache stores the types too, so they have to be parsed regardless of
+	// what is going to be printed.
+	symbol_table = parse_symbol_table(image, section, options.thread_count);
+	parse_stabs(stabs, symbol_table, options);
+	// The output doesn't depend on the cache, so there's no need to give up.
+	if(!write_symbol_table_cache(options.cache_file, key, symbol_table, stabs.arena, stabs.files)) {
+		fprintf(stderr, "warning: Failed to write cache file.\n");
+	}
+	return false;
+}
+
+void parse_stabs(StabsSymbols& stabs, const SymbolTable& symbol_table, const Options& options) {
+	std::vector<StabsFile> files = parse_stabs_files(symbol_table, options.thread_count, options.filter.name_prefix);
+	u64 total_type_count = 0;
+	for(const StabsFile& file : files) {
+		total_type_count += file.arena.types.size();
+	}
+	// Most of the types are defined again in every file that includes the
+	// header they're from, so merge them before doing anything else.
+	StabsTypeInterner interner;
+	stabs.files = intern_stabs_files(interner, files);
+	stabs.arena = std::move(interner.arena);
+	if(options.verbose) {
+		fprintf(stderr, "%32s : %lu\n", "stabs types", total_type_count);
+		fprintf(stderr, "%32s : %lu\n", "unique stabs types", stabs.arena.types.size());
+	}
+}
+
+// Parses a comma separated list of symbol types or classes, given either by name
+// or by number, into a bitmask.
+u64 parse_symbol_kinds(const std::string& list, u32 count, const char* (*name)(u32 i)) {
+	u64 mask = 0;
+	size_t begin = 0;
+	while(begin <= list.size()) {
+		size_t end = list.find(',', begin);
+		if(end == std::string::npos) {
+			end = list.size();
+		}
+		std::string kind = list.substr(begin, end - begin);
+		u32 i = 0;
+		for(; i < count; i++) {
+			const char* kind_name = name(i);
+			if(kind_name && strcasecmp(kind_name, kind.c_str()) == 0) {
+				break;
 			}
-			if(symbol_class_str) {
-				printf("%s ", symbol_class_str);
-			} else {
-				printf("SC(%d) ", (u32) sym.storage_class);
+		}
+		if(i == count) {
+			char* number_end = nullptr;
+			i = (u32) strtoul(kind.c_str(), &number_end, 0);
+			verify(!kind.empty() && *number_end == '\0' && i < count, "error: Invalid symbol type or class '%s'.\n", kind.c_str());
+		}
+		mask |= 1ull << i;
+		begin = end + 1;
+	}
+	return mask;
+}
+
+// The STABS strings are stored as NIL symbols that may be split between several
+// entries, so the name prefix is applied to them once they've been joined back
+// together instead of to the individual symbols.
+SymbolFilter stabs_filter(const Options& options) {
+	SymbolFilter filter;
+	filter.file_pattern = options.filter.file_pattern;
+	filter.types = 1ull << (u32) SymbolType::NIL;
+	filter.classes = 1u << 0;
+	return filter;
+}
+
+bool is_filtered(const SymbolFilter& filter) {
+	return !filter.file_pattern.empty() || filter.types != UINT64_MAX || filter.classes != UINT32_MAX || !filter.name_prefix.empty();
+}
+
+void print_symbols(Output& out, const ProgramImage& image, const ProgramSection& section, const SymbolFilter& filter) {
+	if(out.format == FORMAT_JSON) {
+		begin_json_section(out, "symbols");
+	}
+	bool first_file = true;
+	SymbolTableVisitor visitor;
+	visitor.file = [&](s64, const SymFileDescriptor& fd) {
+		if(print_file_symbols(out, fd.name, fd.symbols.size(), [&](u64 i) { return fd.symbols[i]; }, first_file, filter)) {
+			first_file = false;
+		}
+	};
+	visit_symbol_table(image, section, visitor, filter);
+	if(out.format == FORMAT_JSON) {
+		write_string(out.buffer, "]");
+	}
+}
+
+void print_symbols(Output& out, const SymbolTable& symbol_table, const SymbolFilter& filter) {
+	if(out.format == FORMAT_JSON) {
+		begin_json_section(out, "symbols");
+	}
+	bool first_file = true;
+	for(const SymFileDescriptor& fd : symbol_table.files) {
+		if(file_matches_filter(filter, fd.name)) {
+			if(print_file_symbols(out, fd.name, fd.symbols.size(), [&](u64 i) { return fd.symbols[i]; }, first_file, filter)) {
+				first_file = false;
+			}
+		}
+	}
+	if(out.format == FORMAT_JSON) {
+		write_string(out.buffer, "]");
+	}
+}
+
+void print_symbols(Output& out, const SymbolTableCache& cache, const SymbolFilter& filter) {
+	if(out.format == FORMAT_JSON) {
+		begin_json_section(out, "symbols");
+	}
+	bool first_file = true;
+	for(u64 i = 0; i < cache.file_count(); i++) {
+		const CacheFile& file = cache.file(i);
+		std::string_view name = cache.string(file.name);
+		if(file_matches_filter(filter, name)) {
+			if(print_file_symbols(out, name, file.symbol_count, [&](u64 j) { return cache.symbol(file, j); }, first_file, filter)) {
+				first_file = false;
+			}
+		}
+	}
+	if(out.format == FORMAT_JSON) {
+		write_string(out.buffer, "]");
+	}
+}
+
+// The symbols come from get_symbol, so that they can be read from either a
+// SymbolList or a cache file. If the filter rules out every symbol in the file
+// nothing is printed, and false is returned.
+template <typename GetSymbol>
+bool print_file_symbols(Output& out, std::string_view name, u64 symbol_count, GetSymbol get_symbol, bool first_file, const SymbolFilter& filter) {
+	OutputBuffer& buffer = out.buffer;
+	// Without a symbol filter, files are listed even if they're empty.
+	bool printed = false;
+	auto print_header = [&]() {
+		if(out.format == FORMAT_JSON) {
+			write_string(buffer, first_file ? "\n{\"name\":" : ",\n{\"name\":");
+			write_json_string(buffer, name);
+			write_string(buffer, ",\"symbols\":[");
+		} else {
+			write_string(buffer, "FILE ");
+			write_string(buffer, name);
+			write_string(buffer, ":\n");
+		}
+		printed = true;
+	};
+	if(filter.types == UINT64_MAX && filter.classes == UINT32_MAX && filter.name_prefix.empty()) {
+		print_header();
+	}
+	bool first_symbol = true;
+	for(u64 i = 0; i < symbol_count; i++) {
+		Symbol sym = get_symbol(i);
+		if(!symbol_matches_filter(filter, sym)) {
+			continue;
+		}
+		if(!printed) {
+			print_header();
+		}
+		if(out.format == FORMAT_JSON) {
+			write_string(buffer, first_symbol ? "\n{\"value\":" : ",\n{\"value\":");
+			first_symbol = false;
+			write_decimal(buffer, sym.value);
+			write_string(buffer, ",\"type\":");
+			write_symbol_type(out, sym.storage_type);
+			write_string(buffer, ",\"class\":");
+			write_symbol_class(out, sym.storage_class);
+			write_string(buffer, ",\"index\":");
+			write_decimal(buffer, sym.index);
+			write_string(buffer, ",\"name\":");
+			write_json_string(buffer, sym.string);
+			write_char(buffer, '}');
+			continue;
+		}
+		write_char(buffer, '\t');
+		write_hex(buffer, sym.value);
+		write_char(buffer, ' ');
+		write_symbol_type(out, sym.storage_type);
+		write_char(buffer, ' ');
+		write_symbol_class(out, sym.storage_class);
+		write_char(buffer, ' ');
+		write_decimal(buffer, sym.index);
+		write_char(buffer, ' ');
+		write_string(buffer, sym.string);
+		write_char(buffer, '\n');
+	}
+	if(printed && out.format == FORMAT_JSON) {
+		write_string(buffer, "]}");
+	}
+	return printed;
+}
+
+void print_types(Output& out, const StabsSymbols& stabs) {
+	if(out.format == FORMAT_JSON) {
+		begin_json_section(out, "types");
+	}
+	StabsTypeArenaView arena = stabs.arena.view();
+	bool first_symbol = true;
+	for(const StabsInternedFile& file : stabs.files) {
+		for(size_t i = 0; i < file.symbols.size(); i++) {
+			print_stabs_symbol(out, arena, file.strings[i], file.symbols[i], first_symbol);
+			first_symbol = false;
+		}
+	}
+	if(out.format == FORMAT_JSON) {
+		write_string(out.buffer, "]");
+	}
+}
+
+void print_types(Output& out, const SymbolTableCache& cache) {
+	if(out.format == FORMAT_JSON) {
+		begin_json_section(out, "types");
+	}
+	StabsTypeArenaView arena = cache.stabs_arena();
+	bool first_symbol = true;
+	for(u64 i = 0; i < cache.file_count(); i++) {
+		const CacheFile& file = cache.file(i);
+		const StabsSymbol* symbols = cache.stabs_symbols(file);
+		const CacheString* texts = cache.stabs_texts(file);
+		for(u64 j = 0; j < file.stabs_symbol_count; j++) {
+			print_stabs_symbol(out, arena, cache.string(texts[j]), symbols[j], first_symbol);
+			first_symbol = false;
+		}
+	}
+	if(out.format == FORMAT_JSON) {
+		write_string(out.buffer, "]");
+	}
+}
+
+void print_stabs_symbol(Output& out, const StabsTypeArenaView& arena, std::string_view text, const StabsSymbol& symbol, bool first_symbol) {
+	OutputBuffer& buffer = out.buffer;
+	if(out.format == FORMAT_JSON) {
+		write_string(buffer, first_symbol ? "\n{\"stabs\":" : ",\n{\"stabs\":");
+		write_json_string(buffer, text);
+		write_string(buffer, ",\"fields\":[");
+		bool first_field = true;
+		for_each_stabs_symbol_field(arena, symbol, [&](const StabsField& field) {
+			write_string(buffer, first_field ? "{\"offset\":" : ",{\"offset\":");
+			write_decimal(buffer, field.offset);
+			write_string(buffer, ",\"size\":");
+			write_decimal(buffer, field.size);
+			write_string(buffer, ",\"name\":");
+			write_json_string(buffer, arena.string(field.name));
+			write_char(buffer, '}');
+			first_field = false;
+		});
+		write_string(buffer, "]}");
+		return;
+	}
+	write_string(buffer, "*** PARSING ");
+	write_string(buffer, text);
+	write_char(buffer, '\n');
+	for_each_stabs_symbol_field(arena, symbol, [&](const StabsField& field) {
+		write_hex(buffer, field.offset / 8, 4);
+		write_char(buffer, ' ');
+		write_hex(buffer, field.size / 8, 4);
+		write_char(buffer, ' ');
+		write_hex(buffer, field.offset, 4);
+		write_char(buffer, ' ');
+		write_hex(buffer, field.size, 4);
+		write_char(buffer, ' ');
+		write_string(buffer, arena.string(field.name));
+		write_char(buffer, '\n');
+	});
+}
+
+void print_symbolicated(Output& out, const SymbolTable& symbol_table, const Options& options) {
+	// Batch mode recovers from a bad address, so this can't leak the file.
+	std::shared_ptr<FILE> file(stdin, [](FILE*) {});
+	if(options.samples_file != "-") {
+		FILE* samples = fopen(options.samples_file.c_str(), "r");
+		verify(samples, "error: Failed to open address file.\n");
+		file = std::shared_ptr<FILE>(samples, fclose);
+	}
+	std::vector<u32> addresses = read_address_stream(file.get());
+	file.reset();
+	ProcedureAddressIndex index = build_procedure_address_index(symbol_table);
+	std::vector<ProcedureSampleCount> counts = symbolicate_addresses(symbol_table, index, addresses);
+	OutputBuffer& buffer = out.buffer;
+	if(out.format == FORMAT_JSON) {
+		begin_json_section(out, "symbolicate");
+	}
+	for(size_t i = 0; i < counts.size(); i++) {
+		const ProcedureSampleCount& count = counts[i];
+		const SymProcedureDescriptor* pd = count.procedure >= 0 ? &symbol_table.procedures[count.procedure] : nullptr;
+		std::string_view file_name;
+		if(pd && pd->file >= 0 && pd->file < (s32) symbol_table.files.size()) {
+			file_name = symbol_table.files[pd->file].name;
+		}
+		if(out.format == FORMAT_JSON) {
+			write_string(buffer, i == 0 ? "\n{\"count\":" : ",\n{\"count\":");
+			write_decimal(buffer, count.count);
+			if(pd) {
+				write_string(buffer, ",\"address\":");
+				write_decimal(buffer, pd->address);
+				write_string(buffer, ",\"procedure\":");
+				write_json_string(buffer, pd->name);
+				write_string(buffer, ",\"file\":");
+				write_json_string(buffer, file_name);
+			}
+			write_char(buffer, '}');
+			continue;
+		}
+		write_decimal(buffer, count.count, 10);
+		if(!pd) {
+			write_string(buffer, " ???????? (unknown)\n");
+			continue;
+		}
+		write_char(buffer, ' ');
+		write_hex(buffer, pd->address, 8);
+		write_char(buffer, ' ');
+		write_string(buffer, pd->name);
+		write_char(buffer, ' ');
+		write_string(buffer, file_name);
+		write_char(buffer, '\n');
+	}
+	if(out.format == FORMAT_JSON) {
+		write_string(buffer, "]");
+	}
+}
+
+void write_symbol_diffs(Output& out, const char* name, const std::vector<SymbolDiff>& diffs) {
+	OutputBuffer& buffer = out.buffer;
+	if(out.format == FORMAT_JSON) {
+		begin_json_section(out, name);
+		for(size_t i = 0; i < diffs.size(); i++) {
+			const SymbolDiff& diff = diffs[i];
+			write_string(buffer, i == 0 ? "\n{\"change\":" : ",\n{\"change\":");
+			write_json_string(buffer, diff_change(diff.change));
+			write_string(buffer, ",\"name\":");
+			write_json_string(buffer, diff.name);
+			write_string(buffer, ",\"file\":");
+			write_json_string(buffer, diff.file);
+			if(diff.change != DiffChange::ADDED) {
+				write_string(buffer, ",\"old_value\":");
+				write_decimal(buffer, diff.old_value);
 			}
-			printf("%d %s\n", sym.index, sym.string.c_str());
+			if(diff.change != DiffChange::REMOVED) {
+				write_string(buffer, ",\"new_value\":");
+				write_decimal(buffer, diff.new_value);
+			}
+			write_char(buffer, '}');
+		}
+		write_string(buffer, "]");
+		return;
+	}
+	for(char c : std::string_view(name)) {
+		write_char(buffer, (char) toupper(c));
+	}
+	write_string(buffer, ":\n");
+	for(const SymbolDiff& diff : diffs) {
+		switch(diff.change) {
+			case DiffChange::ADDED:
+				write_string(buffer, "+ ");
+				write_hex(buffer, diff.new_value, 8);
+				break;
+			case DiffChange::REMOVED:
+				write_string(buffer, "- ");
+				write_hex(buffer, diff.old_value, 8);
+				break;
+			case DiffChange::CHANGED:
+				write_string(buffer, "~ ");
+				write_hex(buffer, diff.old_value, 8);
+				write_string(buffer, " -> ");
+				write_hex(buffer, diff.new_value, 8);
+				break;
 		}
+		write_char(buffer, ' ');
+		write_string(buffer, diff.name);
+		write_char(buffer, ' ');
+		write_string(buffer, diff.file);
+		write_char(buffer, '\n');
 	}
 }
 
-void print_types(Program& program, SymbolTable& symbol_table) {
-	for(SymFileDescriptor& fd : symbol_table.files) {
-		std::string prefix;
-		for(Symbol& sym : fd.symbols) {
-			if(sym.storage_type == SymbolType::NIL && (u32) sym.storage_class == 0) {
-				if(sym.string.find("@") == 0 || sym.string.find("$") == 0 || sym.string.size() == 0) {
-					continue;
+void write_struct_diffs(Output& out, const std::vector<StructDiff>& diffs) {
+	OutputBuffer& buffer = out.buffer;
+	if(out.format == FORMAT_JSON) {
+		begin_json_section(out, "structs");
+		for(size_t i = 0; i < diffs.size(); i++) {
+			const StructDiff& diff = diffs[i];
+			write_string(buffer, i == 0 ? "\n{\"change\":" : ",\n{\"change\":");
+			write_json_string(buffer, diff_change(diff.change));
+			write_string(buffer, ",\"name\":");
+			write_json_string(buffer, diff.name);
+			write_string(buffer, ",\"fields\":[");
+			for(size_t j = 0; j < diff.fields.size(); j++) {
+				const FieldDiff& field = diff.fields[j];
+				write_string(buffer, j == 0 ? "{\"change\":" : ",{\"change\":");
+				write_json_string(buffer, diff_change(field.change));
+				write_string(buffer, ",\"name\":");
+				write_json_string(buffer, field.name);
+				if(field.change != DiffChange::ADDED) {
+					write_string(buffer, ",\"old_offset\":");
+					write_decimal(buffer, field.old_offset);
+					write_string(buffer, ",\"old_size\":");
+					write_decimal(buffer, field.old_size);
 				}
-				// Some STABS symbols are split between multiple strings.
-				if(sym.string[sym.string.size() - 1] == '\\') {
-					prefix += sym.string.substr(0, sym.string.size() - 1);
-				} else {
-					std::string full_symbol = prefix + sym.string;
-					printf("*** PARSING %s\n", full_symbol.c_str());
-					StabsSymbol t = parse_stabs_symbol(full_symbol.c_str());
-					prefix = "";
+				if(field.change != DiffChange::REMOVED) {
+					write_string(buffer, ",\"new_offset\":");
+					write_decimal(buffer, field.new_offset);
+					write_string(buffer, ",\"new_size\":");
+					write_decimal(buffer, field.new_size);
 				}
+				write_char(buffer, '}');
+			}
+			write_string(buffer, "]}");
+		}
+		write_string(buffer, "]");
+		return;
+	}
+	write_string(buffer, "STRUCTS:\n");
+	for(const StructDiff& diff : diffs) {
+		const char* prefixes[] = {"+ ", "- ", "~ "};
+		write_string(buffer, prefixes[(u32) diff.change]);
+		write_string(buffer, diff.name);
+		write_char(buffer, '\n');
+		// Byte offset and size, followed by the bit offset and size.
+		for(const FieldDiff& field : diff.fields) {
+			write_char(buffer, '\t');
+			write_string(buffer, prefixes[(u32) field.change]);
+			if(field.change != DiffChange::ADDED) {
+				write_hex(buffer, field.old_offset / 8, 4);
+				write_char(buffer, ' ');
+				write_hex(buffer, field.old_size / 8, 4);
+				write_char(buffer, ' ');
+				write_hex(buffer, field.old_offset, 4);
+				write_char(buffer, ' ');
+				write_hex(buffer, field.old_size, 4);
+				write_char(buffer, ' ');
 			}
+			if(field.change == DiffChange::CHANGED) {
+				write_string(buffer, "-> ");
+			}
+			if(field.change != DiffChange::REMOVED) {
+				write_hex(buffer, field.new_offset / 8, 4);
+				write_char(buffer, ' ');
+				write_hex(buffer, field.new_size / 8, 4);
+				write_char(buffer, ' ');
+				write_hex(buffer, field.new_offset, 4);
+				write_char(buffer, ' ');
+				write_hex(buffer, field.new_size, 4);
+				write_char(buffer, ' ');
+			}
+			write_string(buffer, field.name);
+			write_char(buffer, '\n');
+		}
+	}
+}
+
+void begin_json_section(Output& out, const char* name) {
+	write_string(out.buffer, out.first_section ? "{\"" : ",\n\"");
+	write_string(out.buffer, name);
+	write_string(out.buffer, "\":[");
+	out.first_section = false;
+}
+
+void write_symbol_type(Output& out, SymbolType type) {
+	const char* str = symbol_type(type);
+	if(out.format == FORMAT_JSON) {
+		if(str) {
+			write_json_string(out.buffer, str);
+		} else {
+			write_decimal(out.buffer, (u32) type);
 		}
+	} else if(str) {
+		write_string(out.buffer, str);
+	} else {
+		write_string(out.buffer, "ST(");
+		write_decimal(out.buffer, (u32) type);
+		write_char(out.buffer, ')');
+	}
+}
+
+void write_symbol_class(Output& out, SymbolClass symbol_class) {
+	const char* str = ::symbol_class(symbol_class);
+	if(out.format == FORMAT_JSON) {
+		if(str) {
+			write_json_string(out.buffer, str);
+		} else {
+			write_decimal(out.buffer, (u32) symbol_class);
+		}
+	} else if(str) {
+		write_string(out.buffer, str);
+	} else {
+		write_string(out.buffer, "SC(");
+		write_decimal(out.buffer, (u32) symbol_class);
+		write_char(out.buffer, ')');
 	}
 }
 
 void print_help() {
 	puts("stdump: MIPS/GCC symbol table parser.");
 	puts("");
+	puts("More than one input file can be given, as well as directories, which are");
+	puts("searched for MIPS executables, object files and IOP modules. The inputs");
+	puts("are then processed in parallel, and the output for each one is prefixed");
+	puts("with its path.");
+	puts("");
 	puts("OPTIONS:");
 	puts(" --symbols, -s      Print a list of all the local symbols, grouped");
 	puts("                    by file descriptor.");
 	puts("");
 	puts(" --types, -t        TODO");
 	puts("");
+	puts(" --symbolicate, -a FILE");
+	puts("                    Read hexadecimal addresses (e.g. PC samples from a");
+	puts("                    profiler) from FILE, or stdin if FILE is -, and print");
+	puts("                    how many of them fall within each function.");
+	puts("");
+	puts(" --diff, -d OLD     Compare the input against an older build of the same");
+	puts("                    program, and print the functions and globals that");
+	puts("                    were added, removed or moved, and the structs whose");
+	puts("                    fields were added, removed, moved or resized. Only");
+	puts("                    the files that changed between the two are compared.");
+	puts("");
+	puts(" --server           Load the inputs once and then answer queries read");
+	puts("                    from stdin, one per line, until the end of the input.");
+	puts("                    The inputs are reloaded when they're modified.");
+	puts("                    Queries:");
+	puts("                      symbol NAME         Look up an external symbol.");
+	puts("                      address ADDRESS     Find the function at ADDRESS.");
+	puts("                      type NAME           Print a type and its fields.");
+	puts("                      member TYPE OFFSET  Find the member at OFFSET.");
+	puts("                    Each reply is terminated by a line containing \"end\".");
+	puts("");
+	puts(" --socket PATH      Like --server, but listen on the Unix domain socket");
+	puts("                    at PATH instead and serve connections concurrently.");
+	puts("");
+	puts(" --file GLOB        Only process the file descriptors with names matching");
+	puts("                    GLOB, where * matches any sequence of characters and");
+	puts("                    ? matches any single character.");
+	puts("");
+	puts(" --type LIST        Only print the symbols with one of the storage types");
+	puts("                    in LIST with --symbols, e.g. PROC,GLOBAL. Types can");
+	puts("                    also be given as numbers.");
+	puts("");
+	puts(" --class LIST       Like --type, but for storage classes.");
+	puts("");
+	puts(" --prefix NAME      Only print the symbols, or with --types the STABS");
+	puts("                    symbols, with names that start with NAME.");
+	puts("");
+	puts(" --format, -f FORMAT");
+	puts("                    Either text (the default) or json. The JSON output is");
+	puts("                    a single object with a member for each mode.");
+	puts("");
 	puts(" --verbose, -v      Print out addition information e.g. the offsets of");
 	puts("                    various data structures in the input file.");
+	puts("");
+	puts(" --partial, -p      Only read the ELF headers and the sections that are");
+	puts("                    needed, instead of mapping the whole input file.");
+	puts("");
+	puts(" --threads, -j N    Parse the symbol table using N threads. Defaults to");
+	puts("                    the number of hardware threads.");
+	puts("");
+	puts(" --memory-limit, -m MIB");
+	puts("                    When given multiple input files or a directory, only");
+	puts("                    start on an input while the inputs being processed");
+	puts("                    add up to less than this. Defaults to 1024.");
+	puts("");
+	puts(" --stats            Print how long each phase took and how much was");
+	puts("                    parsed to stderr when finished.");
+	puts("");
+	puts(" --trace FILE       Write the same timings to FILE in the Chrome trace");
+	puts("                    event format.");
+	puts("");
+	puts(" --cache, -c FILE   Load the parsed symbol table from FILE if it was");
+	puts("                    generated from the same input, otherwise parse the");
+	puts("                    input and write the results to FILE. The input is");
+	puts("                    matched by hashing its whole .mdebug section, so a");
+	puts("                    hit still reads all of it, just without parsing.");
 }